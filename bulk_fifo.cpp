@@ -0,0 +1,155 @@
+#ifndef BULK_FIFO_CPP
+#define BULK_FIFO_CPP
+
+#include <atomic>
+#include "systemc.h"
+
+//Single-producer/single-consumer ring used for the server -> processing data path.
+//Data goes in as whole messages: a length word followed by the payload, so the
+//reader never has to look for -1 sentinels. Writes never block; a message that
+//does not fit is rejected as a whole and counted, and the caller can retry later.
+//Written messages reach the reader on publish(), and space the reader frees is
+//seen by the writer from the next publish(). What either side sees then does not
+//depend on whether the kernel runs the reader or the writer first in a delta.
+//The fifo and its buffer may live in memory shared with another process.
+template<class T> class bulk_fifo {
+	public:
+		//CONSTRUCTOR
+		bulk_fifo(int size):_size(size), _head(0), _tail(0), _staged(0), _head_seen(0), _owns_buffer(true) {
+			_buffer = new T[size];
+			_rejected = 0;
+			_messages = 0;
+			_peak = 0;
+		}
+
+		bulk_fifo(int size, T* buffer):_buffer(buffer), _size(size), _head(0), _tail(0), _staged(0), _head_seen(0), _owns_buffer(false) {
+			_rejected = 0;
+			_messages = 0;
+			_peak = 0;
+		}
+
+		~bulk_fifo() {
+			if (_owns_buffer) {
+				delete[] _buffer;
+			}
+		}
+
+		//PRODUCER
+		bool write_n(const T* data, int n) {
+			unsigned long tail = _staged;
+			unsigned long head = _head_seen;
+			if (n < 0 || (int)(tail - head) + n + 1 > _size) {
+				_rejected++;					//backpressure, nothing is written
+				return false;
+			}
+			_buffer[tail % _size] = (T)n;		//length prefix
+			for (int i = 0; i < n; i++) {
+				_buffer[(tail + 1 + i) % _size] = data[i];
+			}
+			_staged = tail + n + 1;
+			_messages++;
+			if ((int)(tail + n + 1 - head) > _peak) {
+				_peak = (int)(tail + n + 1 - head);
+			}
+			return true;
+		}
+
+		void publish() {					//hands everything written so far to the reader
+			_tail.store(_staged, std::memory_order_release);
+			_head_seen = _head.load(std::memory_order_acquire);
+		}
+
+		//CONSUMER
+		int peek_length() const {			//length of the next message, -1 if empty
+			unsigned long head = _head.load(std::memory_order_relaxed);
+			if (head == _tail.load(std::memory_order_acquire)) {
+				return -1;
+			}
+			return (int)_buffer[head % _size];
+		}
+
+		T peek(int offset) const {			//payload word of the next message, -1 if not there
+			int n = peek_length();
+			if (offset < 0 || offset >= n) {
+				return (T)-1;
+			}
+			return _buffer[(_head.load(std::memory_order_relaxed) + 1 + offset) % _size];
+		}
+
+		//copies out one message of at most max words and returns its length, -1 if empty.
+		//A longer message is left unread and -2 returned; peek_length() gives the size it needs.
+		int read_n(T* data, int max) {
+			int n = peek_length();
+			if (n == -1) {
+				return -1;
+			}
+			if (n > max) {
+				return -2;
+			}
+			unsigned long head = _head.load(std::memory_order_relaxed);
+			for (int i = 0; i < n; i++) {
+				data[i] = _buffer[(head + 1 + i) % _size];
+			}
+			_head.store(head + n + 1, std::memory_order_release);
+			return n;
+		}
+
+		//STATUS
+		int num_free() const {
+			return _size - (int)(_staged - _head_seen);
+		}
+
+		int num_available() const {
+			return (int)(_tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire));
+		}
+
+		int rejected() const { return _rejected; }
+		int messages() const { return _messages; }
+		int peak() const { return _peak; }
+
+	private:
+		//LOCAL VAR
+		T* _buffer;
+		int _size;
+		std::atomic<unsigned long> _head;		//only written by the consumer
+		std::atomic<unsigned long> _tail;		//only written by the producer, on publish()
+		unsigned long _staged;					//end of the written messages, producer side
+		unsigned long _head_seen;				//reader position as of the last publish, producer side
+		bool _owns_buffer;
+		int _rejected;							//producer side statistics
+		int _messages;
+		int _peak;
+
+		bulk_fifo(const bulk_fifo&);
+		bulk_fifo& operator=(const bulk_fifo&);
+};
+
+//Port-like handles so modules bind to a bulk_fifo the same way they bind to sc_fifo.
+template<class T> class bulk_fifo_out {
+	public:
+		bulk_fifo_out():_fifo(0) {}
+		void operator()(bulk_fifo<T>& fifo) { _fifo = &fifo; }
+		bool write_n(const T* data, int n) { return _fifo->write_n(data, n); }
+		int num_free() const { return _fifo->num_free(); }
+		void publish() { _fifo->publish(); }
+		bulk_fifo<T>* operator->() const { return _fifo; }
+
+	private:
+		bulk_fifo<T>* _fifo;
+};
+
+template<class T> class bulk_fifo_in {
+	public:
+		bulk_fifo_in():_fifo(0) {}
+		void operator()(bulk_fifo<T>& fifo) { _fifo = &fifo; }
+		int read_n(T* data, int max) { return _fifo->read_n(data, max); }
+		int peek_length() const { return _fifo->peek_length(); }
+		T peek(int offset) const { return _fifo->peek(offset); }
+		int num_available() const { return _fifo->num_available(); }
+		bulk_fifo<T>* operator->() const { return _fifo; }
+
+	private:
+		bulk_fifo<T>* _fifo;
+};
+
+#endif
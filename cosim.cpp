@@ -0,0 +1,233 @@
+#ifndef COSIM_CPP
+#define COSIM_CPP
+
+#include <new>
+#include <deque>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "systemc.h"
+#include "bulk_fifo.cpp"
+#include "frame.cpp"
+
+#define COSIM_SERVER 0				//partition with the server, the robots and the traces, the parent process
+#define COSIM_PROCESSING 1			//partition with processing, a child process
+#define COSIM_PARTITIONS 2
+#define COSIM_WORDS 256				//link words per partition per window
+#define COSIM_WINDOW 5				//ms, half a clock: words sent on a clock edge are used on the next one
+
+//Two partitions of the model run as separate processes and meet every
+//COSIM_WINDOW of simulated time. At the end of a window each partition posts the
+//link words its side sent in that window, then says it is done with the window
+//(the null message) and waits until the other one is too. The words are then
+//replayed into the local kernel at the start of the next window. Nothing crosses
+//the cut faster than half a clock: robots and processing only act on link words
+//at their next clock edge, and the server's speed and path data is published on
+//the falling edge. So both partitions can run a window at the same time and still
+//compute the same clock by clock state as one process.
+typedef struct Cosim_Word {
+	int32_t robot;
+	int32_t reserved;
+	uint64_t frame;					//as it was on the link, see frame.cpp
+}Cosim_Word;
+
+typedef struct Cosim_Batch {
+	uint32_t num_words;
+	uint32_t reserved;
+	Cosim_Word word[COSIM_WORDS];
+}Cosim_Batch;
+
+typedef struct Cosim_Partition {
+	uint64_t window;					//windows finished, the batch of the last one is complete
+	Cosim_Batch batch[2];				//by window parity, a batch is read before its slot comes round again
+}Cosim_Partition;
+
+//End of the link that lives in the other partition. It has the ports of the
+//processing module: in the server partition it is bound where processing would
+//be, in the processing partition it is bound where the robots would be. Words
+//it receives are acknowledged like the real end would and kept for the other
+//partition; words from the other partition are sent on with the same handshake.
+template<int num_of_robots> class cosim_link:public sc_module {
+	public:
+		//PORTS
+		sc_in<bool> tx_ack[num_of_robots];
+		sc_out<bool> tx_flag[num_of_robots];
+		sc_out<frame_word> tx_data[num_of_robots];
+		sc_out<bool> rx_ack[num_of_robots];
+		sc_in<bool> rx_flag[num_of_robots];
+		sc_in<frame_word> rx_data[num_of_robots];
+
+		//CONSTRUCTOR
+		SC_HAS_PROCESS(cosim_link);
+
+		cosim_link(sc_module_name name):sc_module(name) {
+			SC_THREAD(prc_tx);
+			for (int i = 0; i < num_of_robots; i++) {
+				sensitive << tx_ack[i].pos();
+			}
+
+			SC_THREAD(prc_rx);
+			for (int i = 0; i < num_of_robots; i++) {
+				sensitive << rx_flag[i].pos();
+			}
+		}
+
+		//words received since the last call
+		int take(Cosim_Word* words, int max) {
+			int n = 0;
+			while (!_received.empty() && n < max) {
+				words[n++] = _received.front();
+				_received.pop_front();
+			}
+			return n;
+		}
+
+		//words from the other partition, sent when the kernel next runs
+		void send(const Cosim_Word* words, int n) {
+			for (int i = 0; i < n; i++) {
+				_sending.push_back(words[i]);
+			}
+			if (n > 0) {
+				tx_signal.notify(SC_ZERO_TIME);
+			}
+		}
+
+	private:
+		//LOCAL VAR
+		std::deque<Cosim_Word> _received;
+		std::deque<Cosim_Word> _sending;
+		sc_event tx_signal;
+
+		//PROCESS
+		void prc_tx() {
+			while (1) {
+				wait(tx_signal);
+				while (!_sending.empty()) {
+					Cosim_Word word = _sending.front();
+					_sending.pop_front();
+					tx_flag[word.robot] = 1;
+					tx_data[word.robot] = frame_word(word.frame);
+					wait();							//wait for the ack
+					tx_flag[word.robot] = 0;
+					wait(SC_ZERO_TIME);
+				}
+			}
+		}
+
+		void prc_rx() {
+			while (1) {
+				wait();
+				for (int i = 0; i < num_of_robots; i++) {
+					if (rx_flag[i] == 1) {
+						rx_ack[i] = 1;
+						Cosim_Word word = {i, 0, (uint64_t)rx_data[i].read()};
+						_received.push_back(word);
+						wait(SC_ZERO_TIME);
+						rx_ack[i] = 0;
+					}
+				}
+			}
+		}
+};
+
+//Shared memory between the partitions: the window state of each partition, then
+//the server -> processing data fifos with their buffers. Mapped before fork().
+class cosim {
+	public:
+		cosim():_base(0), _size(0), _partition(COSIM_SERVER), _peer(0) {}
+
+		~cosim() {
+			if (_base) {
+				munmap(_base, _size);
+			}
+		}
+
+		bool open(int num_robots, int fifo_size) {
+			_fifo_offset = (sizeof(Cosim_Partition)*COSIM_PARTITIONS + 63) & ~(size_t)63;
+			_fifo_stride = (sizeof(bulk_fifo<int>) + sizeof(int)*fifo_size + 63) & ~(size_t)63;
+			_size = _fifo_offset + _fifo_stride*num_robots;
+			void* base = mmap(0, _size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+			if (base == MAP_FAILED) {
+				return false;
+			}
+			_base = (char*)base;
+			for (int p = 0; p < COSIM_PARTITIONS; p++) {
+				new (_base + sizeof(Cosim_Partition)*p) Cosim_Partition();
+			}
+			for (int i = 0; i < num_robots; i++) {
+				char* slot = _base + _fifo_offset + _fifo_stride*i;
+				new (slot) bulk_fifo<int>(fifo_size, (int*)(slot + sizeof(bulk_fifo<int>)));
+			}
+			return true;
+		}
+
+		bulk_fifo<int>* fifo(int robot) {
+			return (bulk_fifo<int>*)(_base + _fifo_offset + _fifo_stride*robot);
+		}
+
+		//returns the partition this process runs, -1 if the child could not be started
+		int start() {
+			pid_t parent = getpid();
+			pid_t child = fork();
+			if (child == -1) {
+				return -1;
+			}
+			_partition = (child == 0) ? COSIM_PROCESSING : COSIM_SERVER;
+			_peer = (child == 0) ? parent : child;
+			return _partition;
+		}
+
+		int partition() const { return _partition; }
+
+		//end of window number window: post our words, wait for the other partition, replay its words
+		template<int num_of_robots> bool exchange(uint64_t window, cosim_link<num_of_robots>& link) {
+			Cosim_Partition* self = partition_state(_partition);
+			Cosim_Partition* other = partition_state(1 - _partition);
+			Cosim_Batch& batch = self->batch[window & 1];
+			batch.num_words = link.take(batch.word, COSIM_WORDS);
+			__atomic_store_n(&self->window, window, __ATOMIC_RELEASE);
+			for (int spins = 0; __atomic_load_n(&other->window, __ATOMIC_ACQUIRE) < window; spins++) {
+				if ((spins & 1023) == 1023 && peer_gone()) {
+					return false;					//the other partition has gone
+				}
+				sched_yield();
+			}
+			const Cosim_Batch& received = other->batch[window & 1];
+			link.send(received.word, received.num_words);
+			return true;
+		}
+
+		void finish() {							//the server partition waits for processing to exit
+			if (_partition == COSIM_SERVER) {
+				waitpid(_peer, 0, 0);
+			}
+		}
+
+	private:
+		//A child whose parent has gone is reparented, and kill() on the old pid may then
+		//reach another process; a child that has gone stays a zombie kill() still reaches.
+		bool peer_gone() {
+			if (_partition == COSIM_PROCESSING) {
+				return getppid() != _peer;
+			}
+			return waitpid(_peer, 0, WNOHANG) != 0;
+		}
+
+		char* _base;
+		size_t _size;
+		size_t _fifo_offset;
+		size_t _fifo_stride;
+		int _partition;
+		pid_t _peer;
+
+		Cosim_Partition* partition_state(int partition) {
+			return (Cosim_Partition*)(_base + sizeof(Cosim_Partition)*partition);
+		}
+
+		cosim(const cosim&);
+		cosim& operator=(const cosim&);
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef DIRTY_SET_CPP
+#define DIRTY_SET_CPP
+
+#include <stdint.h>
+
+//Agents with pending work, as a bitset. Finding work costs one find-first-set
+//per 64 agents instead of a look at every agent's flag, and agents come out in
+//index order, so a loop over the set visits them in the same order as a scan.
+template<int size> class dirty_set {
+	public:
+		dirty_set():_count(0) {
+			for (int w = 0; w < WORDS; w++) {
+				_words[w] = 0;
+			}
+		}
+
+		bool insert(int i) {					//false if it was already in
+			uint64_t bit = (uint64_t)1 << (i & 63);
+			if (_words[i >> 6] & bit) {
+				return false;
+			}
+			_words[i >> 6] |= bit;
+			_count++;
+			return true;
+		}
+
+		bool erase(int i) {						//false if it was not in
+			uint64_t bit = (uint64_t)1 << (i & 63);
+			if (!(_words[i >> 6] & bit)) {
+				return false;
+			}
+			_words[i >> 6] &= ~bit;
+			_count--;
+			return true;
+		}
+
+		void clear() {
+			for (int w = 0; w < WORDS; w++) {
+				_words[w] = 0;
+			}
+			_count = 0;
+		}
+
+		bool contains(int i) const { return (_words[i >> 6] >> (i & 63)) & 1; }
+		bool empty() const { return _count == 0; }
+		int count() const { return _count; }
+
+		int first() const { return next(-1); }	//-1 if empty
+
+		int next(int i) const {					//first agent after i, -1 if none
+			i++;
+			int w = i >> 6;
+			if (w >= WORDS) {
+				return -1;
+			}
+			uint64_t bits = _words[w] & (~(uint64_t)0 << (i & 63));
+			while (bits == 0) {
+				if (++w == WORDS) {
+					return -1;
+				}
+				bits = _words[w];
+			}
+			return (w << 6) + __builtin_ctzll(bits);
+		}
+
+	private:
+		enum {WORDS = (size + 63)/64};
+		uint64_t _words[WORDS];
+		int _count;
+};
+
+#endif
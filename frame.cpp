@@ -0,0 +1,170 @@
+#ifndef FRAME_CPP
+#define FRAME_CPP
+
+#include <stdint.h>
+#include <algorithm>
+#include "systemc.h"
+
+#define FRAME_STATUSES 3			//statuses one handshake carries
+#define FRAME_QUEUE 16				//statuses a link holds, the frame is the first FRAME_STATUSES
+#define FRAME_NONE 0xFFFF			//grid or speed field not set
+#define FRAME_IDS 256				//message ids per sender in a tag
+
+typedef sc_uint<64> frame_word;		//tx_data/rx_data of every robot link
+
+//One handshake on a robot link. It carries up to FRAME_STATUSES statuses in the
+//order they were queued, with the grid and speed setpoint that belong to them,
+//in one transfer instead of a handshake each. Bits, low to high:
+//	0-1		number of statuses
+//	2-13	statuses, 4 bits each, the first one lowest
+//	14-21	sequence number of the frame on its link
+//	22-37	grid, FRAME_NONE if not set
+//	38-53	speed setpoint in mm/s, FRAME_NONE if not set
+//	54-63	tag of the first status, 0 if not traced (see latency_trace.cpp)
+typedef struct Link_Frame {
+	int count;
+	int status[FRAME_STATUSES];
+	int seq;
+	int grid;
+	int speed;
+	int tag;
+}Link_Frame;
+
+inline const char* const status_names[] =		//one definition shared by every file that includes this
+	{
+		"STOPPED1", "RESTART", "CROSSING", "STOPPED2", "CROSSED",
+		"OK1", "OK2", "STOP1", "STOP2", "RESUME", "SPEED", "PATH"
+	};
+
+//Tag of status k of a frame whose first status has tag first: a tag is the
+//sender (high bits) and a message id that counts up, so the statuses a sender
+//queued one after another have tags that follow on.
+static inline int frame_tag(int first, int k) {
+	return first ? (first & ~(FRAME_IDS - 1)) | ((first + k) & (FRAME_IDS - 1)) : 0;
+}
+
+static inline frame_word frame_pack(const Link_Frame& frame) {
+	uint64_t word = (uint64_t)frame.count;
+	for (int k = 0; k < frame.count; k++) {
+		word |= (uint64_t)(frame.status[k] & 0xF) << (2 + 4*k);
+	}
+	word |= (uint64_t)(frame.seq & 0xFF) << 14;
+	word |= (uint64_t)(frame.grid & 0xFFFF) << 22;
+	word |= (uint64_t)(frame.speed & 0xFFFF) << 38;
+	word |= (uint64_t)(frame.tag & 0x3FF) << 54;
+	return frame_word(word);
+}
+
+static inline Link_Frame frame_unpack(const frame_word& data) {
+	uint64_t word = data;
+	Link_Frame frame;
+	frame.count = word & 0x3;
+	for (int k = 0; k < FRAME_STATUSES; k++) {
+		frame.status[k] = (word >> (2 + 4*k)) & 0xF;
+	}
+	frame.seq = (word >> 14) & 0xFF;
+	frame.grid = (word >> 22) & 0xFFFF;
+	frame.speed = (word >> 38) & 0xFFFF;
+	frame.tag = (word >> 54) & 0x3FF;
+	return frame;
+}
+
+//Statuses waiting to go out on one link. The frame to send is the first
+//FRAME_STATUSES queued; an ack takes the statuses it carried off the front, and
+//the rest goes out in the next frame. A frame that is retried keeps its sequence
+//number and may have grown, but never changes what it already carried, so the
+//receiver can tell what it already has. A request queued right behind the same
+//request adds nothing and is folded into it; CROSSED, SPEED and PATH each stand
+//for a grid or a run of data and are always queued.
+//Each status keeps the tag it was queued with; a frame carries the first one and
+//the receiver counts on from it, which holds as long as nothing was dropped in
+//between. A status with the wrong tag is not matched by the trace, see
+//latency_trace::stamp().
+class frame_queue {
+	public:
+		//CONSTRUCTOR
+		frame_queue() {
+			_frame.count = 0;
+			_frame.seq = 0;
+			_frame.grid = FRAME_NONE;
+			_frame.speed = FRAME_NONE;
+			_frame.tag = 0;
+			_count = 0;
+		}
+
+		bool empty() const { return _count == 0; }
+		int size() const { return _count; }
+		int framed() const { return std::min(_count, FRAME_STATUSES); }	//statuses the next frame carries
+		int status(int k) const { return _status[k]; }
+		int grid() const { return _frame.grid; }
+		int speed() const { return _frame.speed; }
+		int tag(int k) const { return _tag[k]; }
+
+		frame_word word() const {
+			Link_Frame frame = _frame;
+			frame.count = framed();
+			for (int k = 0; k < frame.count; k++) {
+				frame.status[k] = _status[k];
+			}
+			frame.tag = _count ? _tag[0] : 0;
+			return frame_pack(frame);
+		}
+
+		void push(int status, int grid = FRAME_NONE, int speed = FRAME_NONE, int tag = 0) {
+			if (_count == 0 || _status[_count - 1] != status || status == 4 || status == 10 || status == 11) {	//not the same request again
+				if (_count == FRAME_QUEUE) {
+					_count--;						//full: the latest status replaces the last one, never one in a frame
+				}
+				_tag[_count] = tag;
+				_status[_count++] = status;
+			}
+			if (grid != FRAME_NONE) {
+				_frame.grid = grid;
+			}
+			if (speed != FRAME_NONE) {
+				_frame.speed = speed;
+			}
+		}
+
+		void acked(int count) {						//count statuses were delivered
+			for (int k = count; k < _count; k++) {
+				_status[k - count] = _status[k];
+				_tag[k - count] = _tag[k];
+			}
+			_count -= count;
+			_frame.seq = (_frame.seq + 1) & 0xFF;
+			if (_count == 0) {
+				_frame.grid = FRAME_NONE;
+				_frame.speed = FRAME_NONE;
+			}
+		}
+
+		void clear() {
+			acked(_count);
+		}
+
+		//RECEIVER: statuses of frame not seen before, they are queued here
+		int receive(const frame_word& data) {
+			Link_Frame frame = frame_unpack(data);
+			int first = (frame.seq == _received_seq) ? _received_count : 0;	//a retry of the last frame
+			if (first > frame.count) {
+				first = frame.count;
+			}
+			_received_seq = frame.seq;
+			_received_count = frame.count;
+			for (int k = first; k < frame.count; k++) {
+				push(frame.status[k], frame.grid, frame.speed, frame_tag(frame.tag, k));
+			}
+			return frame.count - first;
+		}
+
+	private:
+		Link_Frame _frame;						//sequence number, grid and speed of the next frame
+		int _status[FRAME_QUEUE];
+		int _tag[FRAME_QUEUE];					//trace tag of each status
+		int _count;
+		int _received_seq = -1;
+		int _received_count = 0;
+};
+
+#endif
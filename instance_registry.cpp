@@ -0,0 +1,36 @@
+#ifndef INSTANCE_REGISTRY_CPP
+#define INSTANCE_REGISTRY_CPP
+
+#include <vector>
+
+//Base of a class whose counters are written for all its instances at once, see
+//link_health::write() and channel_model::write(). An instance is in registry()
+//from construction to destruction, in the order they were made.
+template<class type> class instance_registry {
+	protected:
+		//CONSTRUCTOR
+		instance_registry() {
+			registry().push_back(static_cast<type*>(this));
+		}
+
+		~instance_registry() {
+			std::vector<type*>& all = registry();
+			for (int i = 0; i < (int)all.size(); i++) {
+				if (all[i] == static_cast<type*>(this)) {
+					all.erase(all.begin() + i);
+					break;
+				}
+			}
+		}
+
+		static std::vector<type*>& registry() {
+			static std::vector<type*> all;
+			return all;
+		}
+
+	private:
+		instance_registry(const instance_registry&);
+		instance_registry& operator=(const instance_registry&);
+};
+
+#endif
@@ -0,0 +1,343 @@
+#ifndef JUNCTION_GRAPH_CPP
+#define JUNCTION_GRAPH_CPP
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <vector>
+
+//Any step between two neighbouring grids, for plan() on a two-way map.
+typedef struct Any_Step {
+	bool operator()(int, int) const { return true; }
+}Any_Step;
+
+//Map with its corridors contracted. Every walkable grid with other than two
+//walkable neighbours (junctions, dead ends) is a node; the corridor grids
+//between two nodes become one edge with its length and its list of grids.
+//Built from any map with num_grids(), grid_x(grid) and neighbour(grid, dir).
+class junction_graph {
+	public:
+		//CONSTRUCTOR
+		template<class map_type> junction_graph(const map_type* map) {
+			int num_grids = map->num_grids();
+			_grid_node.assign(num_grids + 1, -1);
+			_grid_edge.assign(num_grids + 1, -1);
+			_grid_edge_offset.assign(num_grids + 1, -1);
+			for (int grid = 1; grid <= num_grids; grid++) {
+				if (map->grid_x(grid) != -1 && degree(map, grid) != 2) {
+					add_node(grid, degree(map, grid));
+				}
+			}
+			for (int node = 0; node < (int)_node_grid.size(); node++) {
+				walk_node(map, node);
+			}
+			for (int grid = 1; grid <= num_grids; grid++) {
+				if (map->grid_x(grid) != -1 && _grid_node[grid] == -1 && _grid_edge[grid] == -1) {
+					walk_node(map, add_node(grid, 2));		//corridor loop without junctions
+				}
+			}
+			_node_edges_start.assign(_node_grid.size() + 1, 0);
+			for (int e = 0; e < (int)_edges.size(); e++) {
+				_node_edges_start[_edges[e].from + 1]++;
+				_node_edges_start[_edges[e].to + 1]++;
+			}
+			for (int node = 0; node < (int)_node_grid.size(); node++) {
+				_node_edges_start[node + 1] += _node_edges_start[node];
+			}
+			_node_edges.resize(_edges.size()*2);
+			std::vector<int> fill(_node_edges_start.begin(), _node_edges_start.end() - 1);
+			for (int e = 0; e < (int)_edges.size(); e++) {
+				_node_edges[fill[_edges[e].from]++] = e;
+				_node_edges[fill[_edges[e].to]++] = e;
+			}
+		}
+
+		int node_of(int grid) const { return (grid < 1 || grid >= (int)_grid_node.size()) ? -1 : _grid_node[grid]; }
+
+		bool is_junction(int grid) const {
+			int node = node_of(grid);
+			return node != -1 && _node_degree[node] > 2;
+		}
+
+		//Shortest grid path from -> to (both included) on the contracted graph, returns
+		//its length in grids or -1. step(a, b) says whether a robot may move from grid a
+		//to its neighbour b, so one-way maps are planned with the same graph.
+		template<class allowed> int plan(int from, int to, std::vector<int>& path, const allowed& step) const {
+			path.clear();
+			if (!walkable(from) || !walkable(to)) {
+				return -1;
+			}
+			if (from == to) {
+				path.push_back(from);
+				return 1;
+			}
+			int nodes = _node_grid.size();
+			std::vector<int> dist(nodes, -1);
+			std::vector<int> via(nodes, -1);					//edge used to reach each node
+			Queue queue;
+			int from_edge = _grid_edge[from];
+			int start_cost[2] = {-1, -1};						//leaving the start corridor at its from/to end
+			if (from_edge == -1) {
+				dist[_grid_node[from]] = 0;
+				queue.push(std::make_pair(0, _grid_node[from]));
+			}
+			else {												//start inside a corridor
+				const Edge& edge = _edges[from_edge];
+				int offset = _grid_edge_offset[from];
+				if (passable(step, -1, from_edge, offset, 0, _node_grid[edge.from])) {
+					start_cost[0] = offset + 1;
+					relax(dist, via, queue, edge.from, start_cost[0], -1);
+				}
+				if (passable(step, -1, from_edge, offset, edge.num_cells - 1, _node_grid[edge.to])) {
+					start_cost[1] = edge.num_cells - offset;
+					relax(dist, via, queue, edge.to, start_cost[1], -1);
+				}
+			}
+			while (!queue.empty()) {
+				int d = queue.top().first;
+				int node = queue.top().second;
+				queue.pop();
+				if (d != dist[node]) {
+					continue;
+				}
+				for (int i = _node_edges_start[node]; i < _node_edges_start[node + 1]; i++) {
+					const Edge& edge = _edges[_node_edges[i]];
+					bool forward = (edge.from == node);
+					int other = forward ? edge.to : edge.from;
+					if (forward ? passable(step, _node_grid[node], _node_edges[i], 0, edge.num_cells - 1, _node_grid[other])
+								: passable(step, _node_grid[node], _node_edges[i], edge.num_cells - 1, 0, _node_grid[other])) {
+						relax(dist, via, queue, other, d + edge.length, _node_edges[i]);
+					}
+				}
+			}
+
+			//best way onto the goal: at a node, or through one end of its corridor
+			int best = -1;
+			int best_node = -1;
+			int goal_side = 0;									//0: enter the goal corridor from its from end
+			int to_edge = _grid_edge[to];
+			if (to_edge == -1) {
+				best_node = _grid_node[to];
+				best = dist[best_node];
+			}
+			else {
+				const Edge& edge = _edges[to_edge];
+				int offset = _grid_edge_offset[to];
+				int ends[2] = {edge.from, edge.to};
+				int cost[2] = {offset + 1, edge.num_cells - offset};
+				bool open[2] = {passable(step, _node_grid[edge.from], to_edge, 0, offset, -1),
+								passable(step, _node_grid[edge.to], to_edge, edge.num_cells - 1, offset, -1)};
+				for (int side = 0; side < 2; side++) {
+					if (open[side] && dist[ends[side]] != -1 && (best == -1 || dist[ends[side]] + cost[side] < best)) {
+						best = dist[ends[side]] + cost[side];
+						best_node = ends[side];
+						goal_side = side;
+					}
+				}
+			}
+			if (from_edge != -1 && from_edge == to_edge &&		//both on the same corridor
+				passable(step, -1, to_edge, _grid_edge_offset[from], _grid_edge_offset[to], -1)) {
+				int direct = std::abs(_grid_edge_offset[to] - _grid_edge_offset[from]);
+				if (best == -1 || direct <= best) {
+					append_cells(path, to_edge, _grid_edge_offset[from], _grid_edge_offset[to]);
+					return path.size();
+				}
+			}
+			if (best == -1) {
+				return -1;
+			}
+
+			//walk back from the goal node to the node the search started at
+			std::vector<int> edges;
+			int node = best_node;
+			while (via[node] != -1) {
+				edges.push_back(via[node]);
+				node = (_edges[via[node]].from == node) ? _edges[via[node]].to : _edges[via[node]].from;
+			}
+			if (from_edge != -1) {								//leave the starting corridor
+				const Edge& edge = _edges[from_edge];
+				int side = (node == edge.from) ? 0 : 1;
+				if (edge.from == edge.to) {						//loop, either end reaches the node
+					side = (start_cost[0] != -1 && (start_cost[1] == -1 || start_cost[0] <= start_cost[1])) ? 0 : 1;
+				}
+				append_cells(path, from_edge, _grid_edge_offset[from], side == 0 ? 0 : edge.num_cells - 1);
+			}
+			path.push_back(_node_grid[node]);
+			for (int i = edges.size() - 1; i >= 0; i--) {
+				int e = edges[i];
+				if (_edges[e].from == node) {
+					append_cells(path, e, 0, _edges[e].num_cells - 1);
+					node = _edges[e].to;
+				}
+				else {
+					append_cells(path, e, _edges[e].num_cells - 1, 0);
+					node = _edges[e].from;
+				}
+				path.push_back(_node_grid[node]);
+			}
+			if (to_edge != -1) {								//enter the goal corridor
+				append_cells(path, to_edge, goal_side == 0 ? 0 : _edges[to_edge].num_cells - 1, _grid_edge_offset[to]);
+			}
+			return path.size();
+		}
+
+		int plan(int from, int to, std::vector<int>& path) const {
+			return plan(from, to, path, Any_Step());
+		}
+
+		//Junctions where robots meet from different directions, ascending by grid.
+		//Paths are -1 terminated rows of stride grids. Robots only following each other
+		//through a junction (entering from the same side) do not make it a conflict.
+		void conflict_junctions(const int* paths, int stride, int count, std::vector<int>& junctions) const {
+			std::vector<int> entered(_node_grid.size(), -1);	//grid a junction was first entered from
+			std::vector<int> first_robot(_node_grid.size(), -1);
+			std::vector<bool> conflict(_node_grid.size(), false);
+			for (int robot = 0; robot < count; robot++) {
+				const int* path = paths + robot*stride;
+				for (int i = 1; i < stride && path[i] != -1; i++) {
+					int node = node_of(path[i]);
+					if (node == -1 || !is_junction(path[i])) {
+						continue;
+					}
+					if (first_robot[node] == -1) {
+						first_robot[node] = robot;
+						entered[node] = path[i-1];
+					}
+					else if (first_robot[node] != robot && entered[node] != path[i-1]) {
+						conflict[node] = true;
+					}
+				}
+			}
+			junctions.clear();
+			for (int node = 0; node < (int)_node_grid.size(); node++) {
+				if (conflict[node]) {
+					junctions.push_back(_node_grid[node]);
+				}
+			}
+			std::sort(junctions.begin(), junctions.end());
+		}
+
+	private:
+		//LOCAL VAR
+		typedef struct Edge {
+			int from;			//node at each end
+			int to;
+			int length;			//steps between the two nodes
+			int first_cell;		//corridor grids in _edge_cells
+			int num_cells;
+		}Edge;
+
+		typedef std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int> >, std::greater<std::pair<int, int> > > Queue;
+
+		std::vector<int> _node_grid;			//grid of every node
+		std::vector<int> _node_degree;			//walkable neighbours of every node
+		std::vector<int> _grid_node;			//node of every grid, -1 for corridor grids
+		std::vector<int> _grid_edge;			//edge of every corridor grid, -1 for nodes
+		std::vector<int> _grid_edge_offset;		//position of a corridor grid along its edge
+		std::vector<Edge> _edges;
+		std::vector<int> _edge_cells;
+		std::vector<int> _node_edges_start;		//edges of each node (CSR)
+		std::vector<int> _node_edges;
+		std::vector<int> _node_walked;			//directions of each node already turned into edges
+
+		template<class map_type> static int degree(const map_type* map, int grid) {
+			int n = 0;
+			for (int dir = 0; dir < 4; dir++) {
+				if (map->neighbour(grid, dir) != -1) {
+					n++;
+				}
+			}
+			return n;
+		}
+
+		bool walkable(int grid) const {
+			return node_of(grid) != -1 || (grid >= 1 && grid < (int)_grid_edge.size() && _grid_edge[grid] != -1);
+		}
+
+		int add_node(int grid, int degree) {
+			_grid_node[grid] = _node_grid.size();
+			_node_grid.push_back(grid);
+			_node_degree.push_back(degree);
+			_node_walked.push_back(0);
+			return _node_grid.size() - 1;
+		}
+
+		template<class map_type> void walk_node(const map_type* map, int node) {
+			int grid = _node_grid[node];
+			for (int dir = 0; dir < 4; dir++) {
+				int next = map->neighbour(grid, dir);
+				if (next == -1 || (_node_walked[node] & (1 << dir))) {
+					continue;
+				}
+				Edge edge;
+				edge.from = node;
+				edge.first_cell = _edge_cells.size();
+				int prev = grid;
+				while (_grid_node[next] == -1) {			//follow the corridor to the next node
+					_grid_edge[next] = _edges.size();
+					_grid_edge_offset[next] = _edge_cells.size() - edge.first_cell;
+					_edge_cells.push_back(next);
+					int step = -1;
+					for (int d = 0; d < 4 && step == -1; d++) {
+						int candidate = map->neighbour(next, d);
+						if (candidate != -1 && candidate != prev) {
+							step = candidate;
+						}
+					}
+					prev = next;
+					next = step;
+				}
+				edge.to = _grid_node[next];
+				edge.num_cells = _edge_cells.size() - edge.first_cell;
+				edge.length = edge.num_cells + 1;
+				_node_walked[node] |= 1 << dir;
+				for (int d = 0; d < 4; d++) {				//same corridor seen from the other end
+					if (map->neighbour(next, d) == prev && !(edge.to == node && d == dir)) {
+						_node_walked[edge.to] |= 1 << d;
+						break;
+					}
+				}
+				_edges.push_back(edge);
+			}
+		}
+
+		void relax(std::vector<int>& dist, std::vector<int>& via, Queue& queue, int node, int d, int edge) const {
+			if (dist[node] == -1 || d < dist[node]) {
+				dist[node] = d;
+				via[node] = edge;
+				queue.push(std::make_pair(d, node));
+			}
+		}
+
+		//every step of before, the corridor grids of an edge from offset first to
+		//offset last, then after is allowed; before/after -1 when not part of the run
+		template<class allowed> bool passable(const allowed& step, int before, int edge, int first, int last, int after) const {
+			int prev = before;
+			if (_edges[edge].num_cells > 0) {
+				const int* cells = &_edge_cells[_edges[edge].first_cell];
+				int dir = (last >= first) ? 1 : -1;
+				for (int i = first; i != last + dir; i += dir) {
+					if (prev != -1 && !step(prev, cells[i])) {
+						return false;
+					}
+					prev = cells[i];
+				}
+			}
+			return prev == -1 || after == -1 || step(prev, after);
+		}
+
+		//corridor grids of an edge from offset first to offset last, in either direction
+		void append_cells(std::vector<int>& path, int edge, int first, int last) const {
+			if (_edges[edge].num_cells == 0) {
+				return;
+			}
+			const int* cells = &_edge_cells[_edges[edge].first_cell];
+			int step = (last >= first) ? 1 : -1;
+			for (int i = first; i != last + step; i += step) {
+				path.push_back(cells[i]);
+			}
+		}
+};
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef KPI_CPP
+#define KPI_CPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define KPI_STOPPED 3				//processing status of a stopped robot
+
+//Fleet performance figures collected while the simulation runs. The server
+//reports releases, grid crossings, completions and robots queued in front of an
+//intersection; processing reports each robot's status and speed once per clock.
+//Everything is counted in clocks and converted to seconds when written out.
+class kpi_collector {
+	public:
+		//CONSTRUCTOR
+		kpi_collector(int num_robots, double clock_seconds):_clock_seconds(clock_seconds) {
+			_robots.assign(num_robots, Robot_Kpi());
+			for (int i = 0; i < num_robots; i++) {
+				_robots[i].release = -1;
+				_robots[i].finish = -1;
+				_robots[i].prev_status = -1;
+			}
+		}
+
+		void add_intersection(int grid) {
+			_intersections.push_back(grid);
+			for (int i = 0; i < (int)_robots.size(); i++) {
+				_robots[i].queued.push_back(0);
+			}
+		}
+
+		//SERVER
+		void released(int robot, int clock) {
+			_robots[robot].release = clock;
+		}
+
+		void crossed(int robot) {
+			_robots[robot].grids++;
+		}
+
+		void finished(int robot, int clock) {
+			_robots[robot].finish = clock;
+		}
+
+		void queued(int robot, int grid) {				//one clock waiting to enter an intersection
+			for (int n = 0; n < (int)_intersections.size(); n++) {
+				if (_intersections[n] == grid) {
+					_robots[robot].queued[n]++;
+					return;
+				}
+			}
+		}
+
+		//PROCESSING
+		void robot_state(int robot, int status, int speed) {
+			Robot_Kpi& kpi = _robots[robot];
+			if (kpi.release == -1 || kpi.finish != -1) {
+				return;									//only between release and completion
+			}
+			if (status == KPI_STOPPED) {
+				if (kpi.prev_status != KPI_STOPPED) {
+					kpi.stops++;
+				}
+				kpi.stopped++;
+			}
+			kpi.prev_status = status;
+			kpi.clocks++;
+			kpi.speed_sum += speed;
+			if (speed > kpi.peak_speed) {
+				kpi.peak_speed = speed;
+			}
+		}
+
+		//OUTPUT
+		bool write(const std::string& prefix) const {
+			FILE* csv = fopen((prefix + ".csv").c_str(), "w");
+			FILE* json = fopen((prefix + ".json").c_str(), "w");
+			if (csv == NULL || json == NULL) {
+				if (csv) fclose(csv);
+				if (json) fclose(json);
+				return false;
+			}
+			fprintf(csv, "robot,stops,stopped_s,queued_s");
+			for (int n = 0; n < (int)_intersections.size(); n++) {
+				fprintf(csv, ",queued_%d_s", _intersections[n]);
+			}
+			fprintf(csv, ",mean_speed,peak_speed,grids,release_s,finish_s,completion_s\n");
+			fprintf(json, "{\n  \"clock_s\": %g,\n  \"intersections\": [", _clock_seconds);
+			for (int n = 0; n < (int)_intersections.size(); n++) {
+				fprintf(json, "%d%s", _intersections[n], (n + 1 < (int)_intersections.size()) ? ", " : "");
+			}
+			fprintf(json, "],\n  \"robots\": [\n");
+
+			Robot_Kpi fleet = Robot_Kpi();
+			fleet.queued.assign(_intersections.size(), 0);
+			fleet.release = fleet.finish = -1;
+			int completed = 0;
+			for (int i = 0; i < (int)_robots.size(); i++) {
+				const Robot_Kpi& kpi = _robots[i];
+				int queued = 0;
+				for (int n = 0; n < (int)kpi.queued.size(); n++) {
+					queued += kpi.queued[n];
+				}
+				double mean_speed = kpi.clocks ? (double)kpi.speed_sum/kpi.clocks : 0.0;
+				fprintf(csv, "%d,%d,%.2f,%.2f", i + 1, kpi.stops, seconds(kpi.stopped), seconds(queued));
+				for (int n = 0; n < (int)kpi.queued.size(); n++) {
+					fprintf(csv, ",%.2f", seconds(kpi.queued[n]));
+				}
+				fprintf(csv, ",%.1f,%d,%d,%s,%s,%s\n", mean_speed, kpi.peak_speed, kpi.grids,
+						time_or_empty(kpi.release).c_str(), time_or_empty(kpi.finish).c_str(),
+						time_or_empty(kpi.finish == -1 ? -1 : kpi.finish - kpi.release).c_str());
+
+				fprintf(json, "    {\"robot\": %d, \"stops\": %d, \"stopped_s\": %.2f, \"queued_s\": %.2f, \"queued_by_intersection_s\": [",
+						i + 1, kpi.stops, seconds(kpi.stopped), seconds(queued));
+				for (int n = 0; n < (int)kpi.queued.size(); n++) {
+					fprintf(json, "%.2f%s", seconds(kpi.queued[n]), (n + 1 < (int)kpi.queued.size()) ? ", " : "");
+				}
+				fprintf(json, "], \"mean_speed\": %.1f, \"peak_speed\": %d, \"grids\": %d, \"release_s\": %s, \"finish_s\": %s, \"completion_s\": %s}%s\n",
+						mean_speed, kpi.peak_speed, kpi.grids, time_or_null(kpi.release).c_str(), time_or_null(kpi.finish).c_str(),
+						time_or_null(kpi.finish == -1 ? -1 : kpi.finish - kpi.release).c_str(),
+						(i + 1 < (int)_robots.size()) ? "," : "");
+
+				if (kpi.release != -1 && (fleet.release == -1 || kpi.release < fleet.release)) {
+					fleet.release = kpi.release;
+				}
+				if (kpi.finish != -1) {
+					completed++;
+					fleet.finish = (kpi.finish > fleet.finish) ? kpi.finish : fleet.finish;
+				}
+				fleet.grids += kpi.grids;
+				fleet.stops += kpi.stops;
+				fleet.stopped += kpi.stopped;
+				fleet.clocks += kpi.clocks;
+				fleet.speed_sum += kpi.speed_sum;
+				fleet.peak_speed = (kpi.peak_speed > fleet.peak_speed) ? kpi.peak_speed : fleet.peak_speed;
+				for (int n = 0; n < (int)kpi.queued.size(); n++) {
+					fleet.queued[n] += kpi.queued[n];
+				}
+			}
+
+			//makespan: first release to last completion, only once every robot has completed
+			int makespan = (completed == (int)_robots.size() && fleet.release != -1) ? fleet.finish - fleet.release : -1;
+			double span = seconds(makespan == -1 ? 0 : makespan);
+			double fleet_mean = fleet.clocks ? (double)fleet.speed_sum/fleet.clocks : 0.0;
+			int fleet_queued = 0;
+			for (int n = 0; n < (int)fleet.queued.size(); n++) {
+				fleet_queued += fleet.queued[n];
+			}
+			fprintf(csv, "fleet,%d,%.2f,%.2f", fleet.stops, seconds(fleet.stopped), seconds(fleet_queued));
+			for (int n = 0; n < (int)fleet.queued.size(); n++) {
+				fprintf(csv, ",%.2f", seconds(fleet.queued[n]));
+			}
+			fprintf(csv, ",%.1f,%d,%d,%s,%s,%s\n", fleet_mean, fleet.peak_speed, fleet.grids,
+					time_or_empty(fleet.release).c_str(), time_or_empty(fleet.finish).c_str(), time_or_empty(makespan).c_str());
+			fprintf(json, "  ],\n  \"fleet\": {\"completed\": %d, \"stops\": %d, \"stopped_s\": %.2f, \"queued_s\": %.2f, "
+					"\"mean_speed\": %.1f, \"peak_speed\": %d, \"grids\": %d, \"makespan_s\": %s, "
+					"\"robots_per_min\": %.3f, \"grids_per_s\": %.3f}\n}\n",
+					completed, fleet.stops, seconds(fleet.stopped), seconds(fleet_queued), fleet_mean, fleet.peak_speed,
+					fleet.grids, time_or_null(makespan).c_str(), span > 0 ? completed*60.0/span : 0.0, span > 0 ? fleet.grids/span : 0.0);
+			fclose(csv);
+			fclose(json);
+			return true;
+		}
+
+	private:
+		//LOCAL VAR
+		typedef struct Robot_Kpi {
+			int release;				//clock the path was sent
+			int finish;					//clock the end of the path was reached
+			int grids;					//grids entered
+			int stops;					//times the robot came to a stop
+			int stopped;				//clocks spent stopped
+			int prev_status;
+			int clocks;					//clocks between release and completion
+			long long speed_sum;
+			int peak_speed;
+			std::vector<int> queued;	//clocks waiting in front of each intersection
+		}Robot_Kpi;
+
+		std::vector<Robot_Kpi> _robots;
+		std::vector<int> _intersections;	//grid of each intersection
+		double _clock_seconds;
+
+		double seconds(int clocks) const {
+			return clocks*_clock_seconds;
+		}
+
+		std::string time_or_empty(int clocks) const {
+			if (clocks == -1) {
+				return "";
+			}
+			char text[32];
+			snprintf(text, sizeof(text), "%.2f", seconds(clocks));
+			return text;
+		}
+
+		std::string time_or_null(int clocks) const {
+			return (clocks == -1) ? "null" : time_or_empty(clocks);
+		}
+};
+
+#endif
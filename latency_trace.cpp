@@ -0,0 +1,205 @@
+#ifndef LATENCY_TRACE_CPP
+#define LATENCY_TRACE_CPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "systemc.h"
+#include "frame.cpp"
+
+#define TRACE_BUCKETS 11			//latency histogram buckets, see _bucket_ms
+#define TRACE_STATUSES 16			//statuses fit in 4 bits
+
+enum {TRACE_SERVER = 1, TRACE_PROCESSING, TRACE_ROBOT, TRACE_SENDERS};	//sender of a status, tag 0 is not traced
+enum {TRACE_QUEUED, TRACE_SENT, TRACE_ROBOT_IN, TRACE_ROBOT_OUT, TRACE_RECEIVED, TRACE_APPLIED, TRACE_STAGES};
+
+//How long a status takes from the module that decides it to the one that acts
+//on it, written with -latency <file>. The sender tags the status when it queues
+//it, the tag goes through the robot in the frames (see frame.cpp) and every
+//stage stamps the simulated time and delta count it saw the status at:
+//	queued		send_status() in the server or processing, or the robot for its own STOP1
+//	sent		first try of the frame carrying it
+//	robot_in	robot received it
+//	robot_out	robot sent it on (first try)
+//	received	the other side received it
+//	applied		acted on: the next prc_update, for SPEED at processing the next speed tick
+//Retries keep the first stamp, so they show in the hop after it. A status that is
+//replaced in a full frame, given up on a dead link or still on its way at the end
+//is counted as unfinished. Stamps are kept by the simulation processes only, the
+//trace reads nothing back into the simulation.
+class latency_trace {
+	public:
+		//CONSTRUCTOR
+		latency_trace(int num_robots):_num_robots(num_robots) {
+			_messages.assign(num_robots*TRACE_SENDERS*FRAME_IDS, Message());
+			_next_id.assign(num_robots*TRACE_SENDERS, 0);
+			_stats.assign(TRACE_SENDERS*TRACE_STATUSES, Stats());
+			for (int i = 0; i < (int)_messages.size(); i++) {
+				_messages[i].status = -1;
+			}
+		}
+
+		//SENDER: a new status, its tag goes with it in the frames
+		int open(int robot, int sender, int status) {
+			int& id = _next_id[robot*TRACE_SENDERS + sender];
+			int tag = sender*FRAME_IDS + id;
+			id = (id + 1) % FRAME_IDS;
+			Message& m = message(robot, tag);
+			if (m.status != -1) {
+				stats(sender, m.status).opened++;	//the tag came round before this one finished
+			}
+			m.status = status;
+			for (int s = 0; s < TRACE_STAGES; s++) {
+				m.stamp[s].set = false;
+			}
+			stamp(robot, tag, status, TRACE_QUEUED);
+			return tag;
+		}
+
+		void stamp(int robot, int tag, int status, int stage) {
+			if (tag == 0) {
+				return;
+			}
+			Message& m = message(robot, tag);
+			if (m.status != status || m.stamp[stage].set) {
+				return;								//not the status the tag was given to, or seen before
+			}
+			m.stamp[stage].set = true;
+			m.stamp[stage].time = sc_time_stamp();
+			m.stamp[stage].delta = sc_delta_count();
+		}
+
+		//RECEIVER: the status took effect, it is added to the figures of its kind
+		void applied(int robot, int tag, int status) {
+			if (tag == 0) {
+				return;
+			}
+			stamp(robot, tag, status, TRACE_APPLIED);
+			Message& m = message(robot, tag);
+			if (m.status != status || !m.stamp[TRACE_QUEUED].set) {
+				return;
+			}
+			Stats& s = stats(tag/FRAME_IDS, status);
+			s.opened++;
+			s.applied++;
+			const Stamp& first = m.stamp[TRACE_QUEUED];
+			for (int stage = 0; stage < TRACE_STAGES; stage++) {
+				if (m.stamp[stage].set) {
+					s.stage[stage].count++;
+					s.stage[stage].ms += (m.stamp[stage].time - first.time)/sc_time(1, SC_MS);
+					s.stage[stage].deltas += m.stamp[stage].delta - first.delta;
+				}
+			}
+			double ms = (m.stamp[TRACE_APPLIED].time - first.time)/sc_time(1, SC_MS);
+			uint64_t deltas = m.stamp[TRACE_APPLIED].delta - first.delta;
+			s.max_ms = (ms > s.max_ms) ? ms : s.max_ms;
+			s.max_deltas = (deltas > s.max_deltas) ? deltas : s.max_deltas;
+			int bucket = 0;
+			while (bucket < TRACE_BUCKETS - 1 && ms > _bucket_ms[bucket]) {
+				bucket++;
+			}
+			s.histogram[bucket]++;
+			m.status = -1;
+		}
+
+		bool write(const char* file) {
+			for (int i = 0; i < (int)_messages.size(); i++) {	//never applied
+				if (_messages[i].status != -1) {
+					stats(i/FRAME_IDS % TRACE_SENDERS, _messages[i].status).opened++;
+					_messages[i].status = -1;
+				}
+			}
+			FILE* out = fopen(file, "w");
+			if (out == NULL) {
+				return false;
+			}
+			const char* senders[TRACE_SENDERS] = {"", "server", "processing", "robot"};
+			const char* stages[TRACE_STAGES] = {"queued", "sent", "robot_in", "robot_out", "received", "applied"};
+			fprintf(out, "{\n  \"robots\": %d,\n  \"bucket_ms\": [", _num_robots);
+			for (int b = 0; b < TRACE_BUCKETS - 1; b++) {
+				fprintf(out, "%g, ", _bucket_ms[b]);
+			}
+			fprintf(out, "null],\n  \"messages\": [\n");
+			bool first = true;
+			for (int sender = 1; sender < TRACE_SENDERS; sender++) {
+				for (int status = 0; status < TRACE_STATUSES; status++) {
+					const Stats& s = stats(sender, status);
+					if (s.opened == 0) {
+						continue;
+					}
+					const Stage& e2e = s.stage[TRACE_APPLIED];
+					fprintf(out, "%s    {\"from\": \"%s\", \"status\": \"%s\", \"queued\": %lld, \"applied\": %lld, \"unfinished\": %lld, "
+							"\"mean_ms\": %.3f, \"max_ms\": %.3f, \"mean_deltas\": %.1f, \"max_deltas\": %llu,\n      \"stages\": {",
+							first ? "" : ",\n", senders[sender], status < 12 ? status_names[status] : "?",
+							(long long)s.opened, (long long)s.applied, (long long)(s.opened - s.applied),
+							e2e.count ? e2e.ms/e2e.count : 0.0, s.max_ms, e2e.count ? (double)e2e.deltas/e2e.count : 0.0,
+							(unsigned long long)s.max_deltas);
+					bool first_stage = true;
+					for (int stage = 1; stage < TRACE_STAGES; stage++) {	//mean time since queued
+						if (s.stage[stage].count) {
+							fprintf(out, "%s\"%s\": {\"ms\": %.3f, \"deltas\": %.1f}", first_stage ? "" : ", ", stages[stage],
+									s.stage[stage].ms/s.stage[stage].count, (double)s.stage[stage].deltas/s.stage[stage].count);
+							first_stage = false;
+						}
+					}
+					fprintf(out, "},\n      \"histogram\": [");
+					for (int b = 0; b < TRACE_BUCKETS; b++) {
+						fprintf(out, "%lld%s", (long long)s.histogram[b], (b + 1 < TRACE_BUCKETS) ? ", " : "");
+					}
+					fprintf(out, "]}");
+					first = false;
+				}
+			}
+			fprintf(out, "\n  ]\n}\n");
+			return fclose(out) == 0;
+		}
+
+	private:
+		//LOCAL VAR
+		typedef struct Stamp {
+			bool set;
+			sc_time time;
+			uint64_t delta;			//sc_delta_count()
+		}Stamp;
+
+		typedef struct Message {	//a tagged status on its way
+			int status;				//-1 if the tag is free
+			Stamp stamp[TRACE_STAGES];
+		}Message;
+
+		typedef struct Stage {		//totals since queued over the applied statuses that reached a stage
+			int64_t count;
+			double ms;
+			uint64_t deltas;
+		}Stage;
+
+		typedef struct Stats {		//one kind of status from one sender
+			int64_t opened;
+			int64_t applied;
+			Stage stage[TRACE_STAGES];
+			double max_ms;
+			uint64_t max_deltas;
+			int64_t histogram[TRACE_BUCKETS];
+		}Stats;
+
+		int _num_robots;
+		std::vector<Message> _messages;		//by robot, sender and id
+		std::vector<int> _next_id;			//by robot and sender
+		std::vector<Stats> _stats;
+		//upper bounds of the histogram buckets in ms, the last bucket takes the rest;
+		//0 is within the same instant, one clock is 10 ms and speed ticks are 100 ms apart
+		const double _bucket_ms[TRACE_BUCKETS - 1] = {0, 1, 2, 5, 10, 20, 50, 100, 200, 500};
+
+		Message& message(int robot, int tag) {
+			return _messages[(robot*TRACE_SENDERS + tag/FRAME_IDS)*FRAME_IDS + tag % FRAME_IDS];
+		}
+
+		Stats& stats(int sender, int status) {
+			return _stats[sender*TRACE_STATUSES + status];
+		}
+
+		latency_trace(const latency_trace&);
+		latency_trace& operator=(const latency_trace&);
+};
+
+#endif
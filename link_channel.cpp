@@ -0,0 +1,354 @@
+#ifndef LINK_CHANNEL_CPP
+#define LINK_CHANNEL_CPP
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "systemc.h"
+#include "bulk_fifo.cpp"
+#include "frame.cpp"
+#include "instance_registry.cpp"
+#include "seeded_random.cpp"
+
+#define CHANNEL_FIXED 0				//latency distributions: always the mean
+#define CHANNEL_UNIFORM 1			//mean +- jitter
+#define CHANNEL_NORMAL 2			//mean, jitter as standard deviation
+#define CHANNEL_EXPONENTIAL 3		//mean plus an exponential tail with jitter as its mean
+#define CHANNEL_FRAME_BITS 64		//bits of a handshake frame on the air
+#define CHANNEL_WORD_BITS 32		//bits of a word on the data path
+
+#define CHANNEL_SERVER_ROBOT 0		//impaired links, in config order
+#define CHANNEL_ROBOT_SERVER 1
+#define CHANNEL_PROCESSING_ROBOT 2
+#define CHANNEL_ROBOT_PROCESSING 3
+#define CHANNEL_SERVER_DATA 4		//server -> processing path and speed data
+#define CHANNELS 5
+
+typedef struct Channel_Params {
+	bool impaired;
+	double latency;					//ms, one way
+	double jitter;					//ms
+	int distribution;
+	double drop;					//probability a word or its ack is lost
+	double bandwidth;				//bit/s per robot, 0 for no cap
+}Channel_Params;
+
+//Impairments of the robot links, read from a text file given with -channels:
+//	seed 7
+//	ack_timeout 40						ms, see link_health.cpp
+//	<link> <latency ms> <jitter ms> <fixed|uniform|normal|exponential> <drop> <bandwidth bit/s>
+//where link is server-robot, robot-server, processing-robot, robot-processing,
+//server-data (the server -> processing data path) or all. Lines starting with
+//# are comments. Links not listed stay ideal.
+class channel_config {
+	public:
+		channel_config():_seed(1), _ack_timeout(0) {
+			memset(_params, 0, sizeof(_params));
+		}
+
+		bool load(const char* file_name) {
+			FILE* file = fopen(file_name, "r");
+			if (file == NULL) {
+				return false;
+			}
+			const char* links[CHANNELS] = {"server-robot", "robot-server", "processing-robot", "robot-processing", "server-data"};
+			const char* distributions[4] = {"fixed", "uniform", "normal", "exponential"};
+			char line[256];
+			bool valid = true;
+			while (valid && fgets(line, sizeof(line), file)) {
+				char name[64], distribution[64];
+				Channel_Params params;
+				unsigned long long seed;
+				if (line[0] == '#' || sscanf(line, "%63s", name) != 1) {
+					continue;
+				}
+				if (strcmp(name, "seed") == 0 && sscanf(line, "%*s %llu", &seed) == 1) {
+					_seed = seed;
+					continue;
+				}
+				if (strcmp(name, "ack_timeout") == 0 && sscanf(line, "%*s %d", &_ack_timeout) == 1) {
+					continue;
+				}
+				valid = sscanf(line, "%*s %lf %lf %63s %lf %lf", &params.latency, &params.jitter, distribution,
+							   &params.drop, &params.bandwidth) == 5 && params.latency >= 0 && params.jitter >= 0 &&
+						params.drop >= 0 && params.drop < 1 && params.bandwidth >= 0;
+				params.distribution = -1;
+				for (int d = 0; d < 4; d++) {
+					if (strcmp(distribution, distributions[d]) == 0) {
+						params.distribution = d;
+					}
+				}
+				valid = valid && params.distribution != -1;
+				params.impaired = true;
+				bool known = false;
+				for (int l = 0; valid && l < CHANNELS; l++) {
+					if (strcmp(name, "all") == 0 || strcmp(name, links[l]) == 0) {
+						_params[l] = params;
+						known = true;
+					}
+				}
+				valid = valid && known;
+			}
+			fclose(file);
+			return valid;
+		}
+
+		const Channel_Params& params(int link) const { return _params[link]; }
+		uint64_t seed(int link) const { return _seed*CHANNELS + link; }	//each link draws its own sequence
+		int ack_timeout() const { return _ack_timeout; }					//ms, 0 if not set
+
+	private:
+		uint64_t _seed;
+		int _ack_timeout;
+		Channel_Params _params[CHANNELS];
+};
+
+//Seeded latency and loss of one impaired link, with its counters. Every robot
+//has its own radio on the link: words queue behind each other at the bandwidth
+//cap and arrive in the order they were sent. Counters of every link are written
+//with -kpi as <prefix>_channels.csv.
+class channel_model:public instance_registry<channel_model> {
+	public:
+		//CONSTRUCTOR
+		channel_model(const std::string& name, const Channel_Params& params, uint64_t seed, int robots):
+		_name(name), _params(params), _state(seed), _busy(robots), _last(robots) {
+			_words = 0;
+			_dropped = 0;
+			_delay_total = 0;
+			_delay_max = 0;
+		}
+
+		bool drop() {
+			bool lost = uniform() < _params.drop;
+			_dropped += lost;
+			return lost;
+		}
+
+		//arrival time of bits sent by robot's radio now
+		sc_time arrival(int robot, int bits) {
+			sc_time start = (_busy[robot] > sc_time_stamp()) ? _busy[robot] : sc_time_stamp();
+			_busy[robot] = start + (_params.bandwidth > 0 ? sc_time(bits/_params.bandwidth, SC_SEC) : SC_ZERO_TIME);
+			sc_time at = _busy[robot] + latency();
+			if (at < _last[robot]) {
+				at = _last[robot];					//no overtaking on one radio
+			}
+			_last[robot] = at;
+			double delay = (at - sc_time_stamp()).to_seconds()*1000;
+			_words++;
+			_delay_total += delay;
+			_delay_max = (delay > _delay_max) ? delay : _delay_max;
+			return at;
+		}
+
+		sc_time latency() {							//one way
+			double ms = _params.latency;
+			switch (_params.distribution) {
+				case CHANNEL_UNIFORM:
+					ms += (2*uniform() - 1)*_params.jitter;
+					break;
+				case CHANNEL_NORMAL:				//Box-Muller
+					ms += sqrt(-2*log(1 - uniform()))*cos(2*M_PI*uniform())*_params.jitter;
+					break;
+				case CHANNEL_EXPONENTIAL:
+					ms += -log(1 - uniform())*_params.jitter;
+					break;
+			}
+			return sc_time(ms > 0 ? ms : 0, SC_MS);
+		}
+
+		static bool write(const char* file) {
+			FILE* out = fopen(file, "w");
+			if (out == NULL) {
+				return false;
+			}
+			fprintf(out, "link,latency_ms,jitter_ms,drop,bandwidth_bit_s,words,dropped,mean_delay_ms,max_delay_ms\n");
+			const std::vector<channel_model*>& all = registry();
+			for (int m = 0; m < (int)all.size(); m++) {
+				const channel_model& c = *all[m];
+				fprintf(out, "%s,%g,%g,%g,%g,%lld,%lld,%.3f,%.3f\n", c._name.c_str(), c._params.latency, c._params.jitter,
+						c._params.drop, c._params.bandwidth, (long long)c._words, (long long)c._dropped,
+						c._words ? c._delay_total/c._words : 0.0, c._delay_max);
+			}
+			return fclose(out) == 0;
+		}
+
+	private:
+		std::string _name;
+		Channel_Params _params;
+		uint64_t _state;
+		std::vector<sc_time> _busy;				//radio sending until
+		std::vector<sc_time> _last;				//latest arrival so far
+		int64_t _words;
+		int64_t _dropped;
+		double _delay_total;					//ms
+		double _delay_max;
+
+		double uniform() {						//[0, 1)
+			return (splitmix64(_state) >> 11)*(1.0/9007199254740992.0);
+		}
+
+		channel_model(const channel_model&);
+		channel_model& operator=(const channel_model&);
+};
+
+//One impaired direction of the robot links, bound between the sender and the
+//receiver. A word the sender raises its flag for is lost, or handed to the
+//receiver with the same handshake once the channel delivers it. The receiver's
+//ack travels back with its own latency and may be lost too; the sender only sees
+//it if it is still waiting for that try. Lost words and acks show up as ack
+//timeouts and retries in link_health, and a retried frame is recognised by its
+//sequence number, so the receiver takes its statuses once.
+template<int num_of_robots> class link_channel:public sc_module {
+	public:
+		//PORTS
+		sc_out<bool> rx_ack[num_of_robots];			//sender side
+		sc_in<bool> rx_flag[num_of_robots];
+		sc_in<frame_word> rx_data[num_of_robots];
+		sc_in<bool> tx_ack[num_of_robots];			//receiver side
+		sc_out<bool> tx_flag[num_of_robots];
+		sc_out<frame_word> tx_data[num_of_robots];
+
+		//CONSTRUCTOR
+		SC_HAS_PROCESS(link_channel);
+
+		link_channel(sc_module_name name, const Channel_Params& params, uint64_t seed):
+		sc_module(name), _model((const char*)name, params, seed, num_of_robots) {
+			SC_THREAD(prc_rx);
+			for (int i = 0; i < num_of_robots; i++) {
+				sensitive << rx_flag[i];
+			}
+
+			SC_THREAD(prc_tx);
+
+			for (int i = 0; i < num_of_robots; i++) {
+				_try[i] = 0;
+				_taken[i] = false;
+			}
+		}
+
+	private:
+		//LOCAL VAR
+		typedef struct Transfer {
+			int robot;
+			bool ack;				//ack back to the sender, else a word to the receiver
+			int try_id;				//try of the sender the word or ack belongs to
+			frame_word data;
+		}Transfer;
+
+		channel_model _model;
+		std::multimap<sc_time, Transfer> _pending;	//by arrival, in send order on ties
+		int _try[num_of_robots];
+		bool _taken[num_of_robots];					//flag seen for the current try
+		sc_event wake;
+
+		//PROCESS
+		void prc_rx() {
+			while (1) {
+				wait();
+				for (int i = 0; i < num_of_robots; i++) {
+					if (rx_flag[i] == 0) {
+						_taken[i] = false;				//the try is over, retries raise the flag again
+					}
+					else if (!_taken[i]) {
+						_taken[i] = true;
+						_try[i]++;
+						if (!_model.drop()) {
+							Transfer word = {i, false, _try[i], rx_data[i].read()};
+							_pending.insert(std::make_pair(_model.arrival(i, CHANNEL_FRAME_BITS), word));
+							wake.notify(SC_ZERO_TIME);
+						}
+					}
+				}
+			}
+		}
+
+		void prc_tx() {
+			while (1) {
+				if (_pending.empty()) {
+					wait(wake);
+				}
+				else if (_pending.begin()->first > sc_time_stamp()) {
+					wait(_pending.begin()->first - sc_time_stamp(), wake);
+				}
+				while (!_pending.empty() && _pending.begin()->first <= sc_time_stamp()) {
+					Transfer transfer = _pending.begin()->second;
+					_pending.erase(_pending.begin());
+					int i = transfer.robot;
+					if (transfer.ack) {
+						if (_taken[i] && _try[i] == transfer.try_id && rx_flag[i] == 1) {
+							rx_ack[i] = 1;					//the sender is still waiting for it
+							wait(SC_ZERO_TIME);
+							rx_ack[i] = 0;
+						}
+						continue;
+					}
+					tx_flag[i] = 1;
+					tx_data[i] = transfer.data;
+					wait(tx_ack[i].posedge_event());		//receivers ack at once
+					tx_flag[i] = 0;
+					wait(SC_ZERO_TIME);
+					if (!_model.drop()) {
+						transfer.ack = true;
+						_pending.insert(std::make_pair(sc_time_stamp() + _model.latency(), transfer));
+					}
+				}
+			}
+		}
+};
+
+//Impaired server -> processing data path. Messages the server writes are held
+//until they arrive and only then written to the fifo, in order per robot. The
+//path is reliable: a lost message costs one ack timeout and is sent again.
+class data_channel {
+	public:
+		//CONSTRUCTOR
+		data_channel(const Channel_Params& params, uint64_t seed, int robots, int ack_timeout):
+		_model("server-data", params, seed, robots), _pending(robots), _pending_words(robots, 0),
+		_ack_timeout(ack_timeout, SC_MS) {}
+
+		//false if the fifo could not take it once everything held has arrived
+		bool write(int robot, const int* data, int n, int num_free) {
+			if (_pending_words[robot] + n + 1 > num_free) {
+				return false;
+			}
+			Message message;
+			message.data.assign(data, data + n);
+			message.at = _model.arrival(robot, (n + 1)*CHANNEL_WORD_BITS);
+			while (_model.drop()) {
+				message.at += _ack_timeout + _model.latency();
+			}
+			_pending[robot].push_back(message);
+			_pending_words[robot] += n + 1;
+			return true;
+		}
+
+		void deliver(int robot, bulk_fifo_out<int>& fifo) {	//messages that have arrived by now
+			std::deque<Message>& pending = _pending[robot];
+			while (!pending.empty() && pending.front().at <= sc_time_stamp()) {
+				fifo.write_n(&pending.front().data[0], pending.front().data.size());
+				_pending_words[robot] -= pending.front().data.size() + 1;
+				pending.pop_front();
+			}
+		}
+
+	private:
+		typedef struct Message {
+			sc_time at;
+			std::vector<int> data;
+		}Message;
+
+		channel_model _model;
+		std::vector<std::deque<Message> > _pending;
+		std::vector<int> _pending_words;
+		sc_time _ack_timeout;
+
+		data_channel(const data_channel&);
+		data_channel& operator=(const data_channel&);
+};
+
+#endif
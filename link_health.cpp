@@ -0,0 +1,120 @@
+#ifndef LINK_HEALTH_CPP
+#define LINK_HEALTH_CPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "systemc.h"
+#include "instance_registry.cpp"
+
+#define LINK_ACK_TIMEOUT 1			//ms without an ack before a try has failed, unless set_ack_timeout()
+#define LINK_BACKOFF_MAX 64			//ms, longest wait before the next try
+#define LINK_RETRIES 6				//failed tries of one word before its link is dead
+
+//Handshake state of the links one module sends on. A word that is not acked in
+//LINK_ACK_TIMEOUT is tried again after a backoff that doubles with every failed
+//try, so a slow or dead receiver costs the sender one timeout per try and the
+//other links carry on in between. After LINK_RETRIES failures the word is given
+//up and the link is dead: later words get a single try each until one is acked.
+//Counters of every link are written with -links <file>.
+class link_health:public instance_registry<link_health> {
+	public:
+		//CONSTRUCTOR
+		link_health(const std::string& name, int links):_name(name), _links(links, Link()) {
+			for (int i = 0; i < links; i++) {
+				_links[i].name = std::to_string(i);
+			}
+		}
+
+		static void set_ack_timeout(int ms) { ack_timeout() = ms; }	//links with latency need more than the default
+
+		void name_link(int link, const std::string& name) { _links[link].name = name; }
+		sc_time timeout() const { return sc_time(ack_timeout(), SC_MS); }
+		bool ready(int link) const { return sc_time_stamp() >= _links[link].retry_at; }
+		sc_time retry_at(int link) const { return _links[link].retry_at; }
+		bool dead(int link) const { return _links[link].dead; }
+
+		void sent(int link) {
+			_links[link].sent++;
+		}
+
+		void acked(int link) {
+			Link& l = _links[link];
+			l.acked++;
+			l.failures = 0;
+			l.dead = false;
+		}
+
+		//true: try the word again once ready(), false: give it up
+		bool timed_out(int link) {
+			Link& l = _links[link];
+			l.timeouts++;
+			l.failures++;
+			if (l.dead || l.failures >= LINK_RETRIES) {
+				if (!l.dead) {
+					l.deaths++;
+				}
+				l.dead = true;
+				l.dropped++;
+				l.failures = 0;
+				return false;
+			}
+			int backoff = ack_timeout() << (l.failures - 1);
+			int most = (ack_timeout() > LINK_BACKOFF_MAX) ? ack_timeout() : LINK_BACKOFF_MAX;
+			l.retry_at = sc_time_stamp() + sc_time(backoff < most ? backoff : most, SC_MS);
+			l.retries++;
+			return true;
+		}
+
+		static bool write(const char* file) {
+			FILE* out = fopen(file, "w");
+			if (out == NULL) {
+				return false;
+			}
+			fprintf(out, "{\n  \"ack_timeout_ms\": %d,\n  \"backoff_max_ms\": %d,\n  \"retries\": %d,\n  \"links\": [\n",
+					ack_timeout(), LINK_BACKOFF_MAX, LINK_RETRIES);
+			const std::vector<link_health*>& all = registry();
+			bool first = true;
+			for (int m = 0; m < (int)all.size(); m++) {
+				for (int i = 0; i < (int)all[m]->_links.size(); i++) {
+					const Link& l = all[m]->_links[i];
+					fprintf(out, "%s    {\"from\": \"%s\", \"to\": \"%s\", \"sent\": %d, \"acked\": %d, \"timeouts\": %d, "
+							"\"retries\": %d, \"dropped\": %d, \"deaths\": %d, \"dead\": %s}",
+							first ? "" : ",\n", all[m]->_name.c_str(), l.name.c_str(), l.sent, l.acked, l.timeouts,
+							l.retries, l.dropped, l.deaths, l.dead ? "true" : "false");
+					first = false;
+				}
+			}
+			fprintf(out, "\n  ]\n}\n");
+			fclose(out);
+			return true;
+		}
+
+	private:
+		//LOCAL VAR
+		typedef struct Link {
+			std::string name;		//the receiving end
+			int sent;				//tries, counting retries
+			int acked;
+			int timeouts;
+			int retries;			//tries scheduled after a timeout
+			int dropped;			//words given up
+			int deaths;				//times the link was declared dead
+			int failures;			//failed tries of the word in flight
+			bool dead;
+			sc_time retry_at;		//no try before this
+		}Link;
+
+		std::string _name;
+		std::vector<Link> _links;
+
+		static int& ack_timeout() {
+			static int ms = LINK_ACK_TIMEOUT;
+			return ms;
+		}
+
+		link_health(const link_health&);
+		link_health& operator=(const link_health&);
+};
+
+#endif
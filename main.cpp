@@ -1,16 +1,80 @@
 #include "processing.cpp"
 #include "robot.cpp"
 #include "server.cpp"
+#include "cosim.cpp"
+#include "realtime_pacer.cpp"
 
 #include "systemc.h"
 
-#define CLOCK_FREQUENCY 100
+#ifdef SCENARIO
+#include SCENARIO			//generated by tools/scenario_gen.cpp, replaces the hand-drawn scenario below
+#else
 #define MAP_SIZE_X 10
 #define MAP_SIZE_Y 9
-#define GRID_SIZE 2000		//represents 2000 mmm
 #define NUM_OF_ROBOTS 4
 #define NUM_OF_OBSTACLES 6
+#define PATH_LENGTH 23
+#define NUM_NODE_ORDERS 6
+#define SIM_TIME ((2700)*2)*10		//ms
+
+static constexpr int scenario_map[MAP_SIZE_Y][MAP_SIZE_X] =
+{	
+	{	1,	2,	3,	4,	5,	6,	7,	8,	9,	10,	},
+ 	{	11,	-1,	-1,	-1,	-1,	-1,	-1,	-1,	-1,	12	},
+ 	{	13,	14,	15,	16,	17,	18,	19,	20,	21,	22	},
+	{	23,	-1,	-1,	-1,	-1,	24,	-1,	-1,	-1,	25	},
+	{	26,	27,	28,	29,	30,	31,	32,	33,	34,	35	},
+	{	36,	-1,	-1,	-1,	-1,	-1,	37,	-1,	-1,	38	},
+	{	39,	40,	41,	42,	43,	44,	45,	46,	47,	48	},
+	{	49,	-1,	-1,	-1,	-1,	-1,	-1,	-1,	-1,	50	},
+	{	51,	52,	53,	54,	55,	56,	57,	58,	59,	60	}
+};
+
+static constexpr int scenario_robot_path[NUM_OF_ROBOTS][PATH_LENGTH] =
+{
+	{	1,11,13,14,15,16,17,18,24,31,30,29,28,27,26,36,39,49,51,52,53,-1	},
+	{	10,12,22,21,20,19,18,24,31,32,33,34,35,25,-1	},
+	{	51,49,39,36,26,27,28,29,30,31,32,37,45,46,47,48,38,-1	},
+	{	60,50,48,47,46,45,44,43,42,41,40,39,36,26,23,-1	}
+};
+
+static constexpr int scenario_path_release[NUM_OF_ROBOTS] =		//clock count at which each robot gets its path
+{	101,	501,	701,	201	};
+
+static constexpr int scenario_node_order[NUM_NODE_ORDERS][NUM_OF_ROBOTS + 1] =		//crossing order at intersections: node, then robots
+{
+	{	18,	1,	0,	-1,	-1	},
+	{	26,	2,	3,	0,	-1	},
+	{	31,	1,	2,	0,	-1	},
+	{	39,	2,	3,	0,	-1	},
+	{	45,	3,	2,	-1,	-1	},
+	{	48,	3,	2,	-1,	-1	}
+};
+
+static constexpr int scenario_obstacle_path[NUM_OF_OBSTACLES][PATH_LENGTH] =
+{
+	{	6,	5,	4,	3,	2,	1,	11,	13,	14,	15, 16,	17,	18,	19,	20,	21,	22,	12,	10,	9,	8,	7,	6	},
+	{	18,	17,	16,	15,	14,	13,	23,	26,	27,	28,	29,	30,	31,	24,	18	},
+	{	22,	21,	20,	19,	18,	24,	31,	32,	33,	34,	35,	25,	22	},
+	{	32,	31,	30,	29,	28,	27,	26,	36,	39,	40,	41,	42,	43,	44,	45,	37,	32	},
+	{	35,	34,	33,	32,	37,	45,	46,	47,	48,	38,	35	},
+	{	45,	46,	47,	48,	50,	60,	59,	58,	57,	56,	55,	54,	53,	52,	51,	49,	39,	40,	41,	42,	43,	44,	45	}
+};
+#endif
+
+#define CLOCK_FREQUENCY 100
+#define GRID_SIZE 2000		//represents 2000 mmm
+#define DEFAULT_MAP_FILE "warehouse.map"	//written from the scenario map unless -map <file> is given
 #define GRID_SIZE_SCALED GRID_SIZE*CLOCK_FREQUENCY
+#define FIFO_SIZE 80
+#define PROCESSING_LOG "processing.log"	//console output of the processing partition
+#define REALTIME_REPORT "realtime.json"	//tick slack and jitter of a -realtime run
+
+#ifdef STATIC_SCENARIO						//map tables and intersections built by the compiler, see static_map.cpp
+typedef static_map<MAP_SIZE_X, MAP_SIZE_Y, scenario_map, NUM_OF_ROBOTS, PATH_LENGTH, scenario_robot_path> map_type;
+#else
+typedef map_view map_type;					//loaded at run time, any map of the right size
+#endif
 
 template<int program_size> class stimulus:public sc_module {
 	public:
@@ -42,108 +106,320 @@ int sc_main(int argc, char* argv[]) {
     sc_signal<bool> clock;
 	sc_signal<bool> tx_ack_s[NUM_OF_ROBOTS];
 	sc_signal<bool> tx_flag_s[NUM_OF_ROBOTS];
-	sc_signal<sc_uint<16> > tx_data_s[NUM_OF_ROBOTS];
+	sc_signal<frame_word> tx_data_s[NUM_OF_ROBOTS];
 	sc_signal<bool> rx_ack_s[NUM_OF_ROBOTS];
 	sc_signal<bool> rx_flag_s[NUM_OF_ROBOTS];
-	sc_signal<sc_uint<16> > rx_data_s[NUM_OF_ROBOTS];
+	sc_signal<frame_word> rx_data_s[NUM_OF_ROBOTS];
 	sc_signal<bool> tx_ack_p[NUM_OF_ROBOTS];
 	sc_signal<bool> tx_flag_p[NUM_OF_ROBOTS];
-	sc_signal<sc_uint<16> > tx_data_p[NUM_OF_ROBOTS];
+	sc_signal<frame_word> tx_data_p[NUM_OF_ROBOTS];
 	sc_signal<bool> rx_ack_p[NUM_OF_ROBOTS];
 	sc_signal<bool> rx_flag_p[NUM_OF_ROBOTS];
-	sc_signal<sc_uint<16> > rx_data_p[NUM_OF_ROBOTS];
-	sc_fifo<int> fifo_data_robot1(80);
-	sc_fifo<int> fifo_data_robot2(80);
-	sc_fifo<int> fifo_data_robot3(80);
-	sc_fifo<int> fifo_data_robot4(80);
+	sc_signal<frame_word> rx_data_p[NUM_OF_ROBOTS];
+	std::vector<bulk_fifo<int>*> fifo_data(NUM_OF_ROBOTS);
+	for (int i = 0; i < NUM_OF_ROBOTS; i++) {
+		fifo_data[i] = new bulk_fifo<int>(FIFO_SIZE);
+	}
 	
 	//LOCAL VAR
-	const int map[MAP_SIZE_Y][MAP_SIZE_X] = 
-	{	
-		{	1,	2,	3,	4,	5,	6,	7,	8,	9,	10,	},
-	 	{	11,	-1,	-1,	-1,	-1,	-1,	-1,	-1,	-1,	12	},
-	 	{	13,	14,	15,	16,	17,	18,	19,	20,	21,	22	},
-		{	23,	-1,	-1,	-1,	-1,	24,	-1,	-1,	-1,	25	},
-		{	26,	27,	28,	29,	30,	31,	32,	33,	34,	35	},
-		{	36,	-1,	-1,	-1,	-1,	-1,	37,	-1,	-1,	38	},
-		{	39,	40,	41,	42,	43,	44,	45,	46,	47,	48	},
-		{	49,	-1,	-1,	-1,	-1,	-1,	-1,	-1,	-1,	50	},
-		{	51,	52,	53,	54,	55,	56,	57,	58,	59,	60	}
-	};
-	const int robot_path[NUM_OF_ROBOTS][23] =
-	{
-		{	1,11,13,14,15,16,17,18,24,31,30,29,28,27,26,36,39,49,51,52,53,-1	},
-		{	10,12,22,21,20,19,18,24,31,32,33,34,35,25,-1	},
-		{	51,49,39,36,26,27,28,29,30,31,32,37,45,46,47,48,38,-1	},
-		{	60,50,48,47,46,45,44,43,42,41,40,39,36,26,23,-1	}
-	};
-	const int obstacle_path[NUM_OF_OBSTACLES][23] =
-	{
-		{	6,	5,	4,	3,	2,	1,	11,	13,	14,	15, 16,	17,	18,	19,	20,	21,	22,	12,	10,	9,	8,	7,	6	},
-		{	18,	17,	16,	15,	14,	13,	23,	26,	27,	28,	29,	30,	31,	24,	18	},
-		{	22,	21,	20,	19,	18,	24,	31,	32,	33,	34,	35,	25,	22	},
-		{	32,	31,	30,	29,	28,	27,	26,	36,	39,	40,	41,	42,	43,	44,	45,	37,	32	},
-		{	35,	34,	33,	32,	37,	45,	46,	47,	48,	38,	35	},
-		{	45,	46,	47,	48,	50,	60,	59,	58,	57,	56,	55,	54,	53,	52,	51,	49,	39,	40,	41,	42,	43,	44,	45	}
-	};
+	const int (&map)[MAP_SIZE_Y][MAP_SIZE_X] = scenario_map;
+	const int (&robot_path)[NUM_OF_ROBOTS][PATH_LENGTH] = scenario_robot_path;
+	const int (&path_release)[NUM_OF_ROBOTS] = scenario_path_release;
+	const int (&node_order)[NUM_NODE_ORDERS][NUM_OF_ROBOTS + 1] = scenario_node_order;
+	const int (&obstacle_path)[NUM_OF_OBSTACLES][PATH_LENGTH] = scenario_obstacle_path;
 	
+	//ARGUMENTS
+	const char* map_file = 0;
+	int speed_policy = SPEED_SCHEDULE;
+	const char* telemetry_name = 0;
+	const char* kpi_prefix = 0;
+	const char* hash_file = 0;
+	int hash_interval = 1;
+	int threads = 1;
+	int num_zones = 1;
+	int num_partitions = 1;
+	int quantum = 0;
+	const char* links_file = 0;
+	const char* channels_file = 0;
+	const char* obstacle_mix_list = "cyclic";
+	const char* latency_file = 0;
+	double realtime = 0;
+	for (int i = 1; i < argc - 1; i++) {
+		if (strcmp(argv[i], "-map") == 0) {
+			map_file = argv[++i];
+		}
+		else if (strcmp(argv[i], "-speed") == 0) {
+			speed_policy = (strcmp(argv[++i], "greedy") == 0) ? SPEED_GREEDY : SPEED_SCHEDULE;
+		}
+		else if (strcmp(argv[i], "-telemetry") == 0) {
+			telemetry_name = argv[++i];					//POSIX shm name, e.g. /warehouse
+		}
+		else if (strcmp(argv[i], "-kpi") == 0) {
+			kpi_prefix = argv[++i];						//writes <prefix>.csv and <prefix>.json
+		}
+		else if (strcmp(argv[i], "-hash") == 0) {
+			hash_file = argv[++i];						//state hashes, compare with tools/hash_compare.cpp
+		}
+		else if (strcmp(argv[i], "-hash-every") == 0) {
+			hash_interval = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-threads") == 0) {
+			threads = atoi(argv[++i]);					//parallel physics step, results match the serial step
+		}
+		else if (strcmp(argv[i], "-zones") == 0) {
+			num_zones = atoi(argv[++i]);				//regional controllers in the server, robots are handed off between them
+		}
+		else if (strcmp(argv[i], "-partitions") == 0) {
+			num_partitions = atoi(argv[++i]);			//2: processing runs in its own process, see cosim.cpp
+		}
+		else if (strcmp(argv[i], "-quantum") == 0) {
+			quantum = atoi(argv[++i]);					//ms, robots relay up to a quantum late, see robot::prc_relay
+		}
+		else if (strcmp(argv[i], "-links") == 0) {
+			links_file = argv[++i];						//handshake retry counters of every link, see link_health.cpp
+		}
+		else if (strcmp(argv[i], "-channels") == 0) {
+			channels_file = argv[++i];					//latency and loss of the links, see link_channel.cpp
+		}
+		else if (strcmp(argv[i], "-obstacle-mix") == 0) {
+			obstacle_mix_list = argv[++i];				//e.g. cyclic,walker,forklift,random, see obstacle_behaviour.cpp
+		}
+		else if (strcmp(argv[i], "-latency") == 0) {
+			latency_file = argv[++i];					//status latencies from sender to where they take effect, see latency_trace.cpp
+		}
+		else if (strcmp(argv[i], "-realtime") == 0) {
+			realtime = atof(argv[++i]);					//clock ticks paced to the wall clock at this speed, see realtime_pacer.cpp
+		}
+	}
+	
+	std::vector<int> obstacle_kinds;
+	if (!obstacle_mix(obstacle_mix_list, NUM_OF_OBSTACLES, obstacle_kinds)) {
+		cout << "Error: unknown obstacle behaviour in " << obstacle_mix_list << endl;
+		return 1;
+	}
+	
+	//MAP FILE
+#ifdef STATIC_SCENARIO
+	if (map_file != 0) {
+		cout << "Error: this build has its map built in, -map is not supported" << endl;
+		return 1;
+	}
+#endif
+	if (map_file == 0) {
+		map_file = DEFAULT_MAP_FILE;
+		if (!map_file_write(map_file, (const int*)map, MAP_SIZE_X, MAP_SIZE_Y)) {
+			cout << "Error: could not write map file " << map_file << endl;
+			return 1;
+		}
+	}
+	map_view map_data;
+	if (!map_data.open(map_file) || map_data.size_x() != MAP_SIZE_X || map_data.size_y() != MAP_SIZE_Y) {
+		cout << "Error: could not load a " << MAP_SIZE_X << "x" << MAP_SIZE_Y << " map from " << map_file << endl;
+		return 1;
+	}
+#ifdef STATIC_SCENARIO
+	map_type baked_map;
+	const map_type* module_map = &baked_map;
+#else
+	const map_type* module_map = &map_data;
+#endif
+	junction_graph graph(&map_data);		//corridors contracted to junctions, shared by all modules
+	zone_map zones(&map_data, num_zones);	//map columns split between the server's zones
+	telemetry_publisher telemetry;			//live state for local readers, see tools/telemetry_reader.cpp
+	telemetry_publisher* telemetry_ptr = 0;
+	if (telemetry_name != 0) {
+		if (!telemetry.open(telemetry_name, NUM_OF_ROBOTS, NUM_OF_OBSTACLES)) {
+			cout << "Error: could not create telemetry region " << telemetry_name << endl;
+			return 1;
+		}
+		telemetry_ptr = &telemetry;
+	}
+	
+	quantum_keeper::set_global_quantum(sc_time(quantum, SC_MS));
+	channel_config channels;				//every link ideal unless -channels is given
+	if (channels_file != 0) {
+		if (!channels.load(channels_file)) {
+			cout << "Error: could not load link channels from " << channels_file << endl;
+			return 1;
+		}
+		if (channels.ack_timeout() > 0) {
+			link_health::set_ack_timeout(channels.ack_timeout());	//both partitions
+		}
+	}
+	
+	//PARTITIONS
+	cosim partitions;
+	int partition = -1;						//-1 when everything runs in this process
+	std::string processing_hash;
+	std::string processing_links;
+	if (num_partitions > 1) {
+		if (kpi_prefix != 0) {
+			cout << "Error: -kpi needs the server and processing in one process" << endl;
+			return 1;
+		}
+		if (latency_file != 0) {
+			cout << "Error: -latency needs the server and processing in one process" << endl;
+			return 1;
+		}
+		if (!partitions.open(NUM_OF_ROBOTS, FIFO_SIZE) || (partition = partitions.start()) == -1) {
+			cout << "Error: could not start the processing partition" << endl;
+			return 1;
+		}
+		for (int i = 0; i < NUM_OF_ROBOTS; i++) {
+			fifo_data[i] = partitions.fifo(i);
+		}
+		if (partition == COSIM_PROCESSING) {
+			int log = open(PROCESSING_LOG, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (log == -1 || dup2(log, 1) == -1) {
+				_exit(1);
+			}
+			close(log);
+			if (hash_file != 0) {
+				processing_hash = std::string(hash_file) + ".processing";	//each partition hashes its own state
+				hash_file = processing_hash.c_str();
+			}
+			if (links_file != 0) {
+				processing_links = std::string(links_file) + ".processing";
+				links_file = processing_links.c_str();
+			}
+		}
+	}
+	kpi_collector kpi(NUM_OF_ROBOTS, 0.01);	//one clock is 10 ms
+	kpi_collector* kpi_ptr = kpi_prefix ? &kpi : 0;
+	state_hasher hash;
+	state_hasher* hash_ptr = hash_file ? &hash : 0;
+	latency_trace trace(NUM_OF_ROBOTS);
+	latency_trace* trace_ptr = latency_file ? &trace : 0;
 
-    //MODULES
-	sc_trace_file* speed = sc_create_vcd_trace_file("robot_trace");
-    processing<MAP_SIZE_X, MAP_SIZE_Y, GRID_SIZE_SCALED, NUM_OF_ROBOTS, NUM_OF_OBSTACLES> processing("processing", (const int*)map, (const int*) obstacle_path, speed);
-	processing.clock(clock);
-	for (int i = 0; i < NUM_OF_ROBOTS; i++) {
-		processing.tx_ack[i](rx_ack_p[i]);
-		processing.tx_flag[i](rx_flag_p[i]);
-		processing.tx_data[i](rx_data_p[i]);
-		processing.rx_ack[i](tx_ack_p[i]);
-		processing.rx_flag[i](tx_flag_p[i]);
-		processing.rx_data[i](tx_data_p[i]);
-	}
-	processing.fifo_data[0](fifo_data_robot1);
-	processing.fifo_data[1](fifo_data_robot2);
-	processing.fifo_data[2](fifo_data_robot3);
-	processing.fifo_data[3](fifo_data_robot4);
-
-    server<MAP_SIZE_X, MAP_SIZE_Y, NUM_OF_ROBOTS> server("processing", (const int*)map, (const int*) robot_path);
-	server.clock(clock);
-	for (int i = 0; i < NUM_OF_ROBOTS; i++) {
-		server.tx_ack[i](rx_ack_s[i]);
-		server.tx_flag[i](rx_flag_s[i]);
-		server.tx_data[i](rx_data_s[i]);
-		server.rx_ack[i](tx_ack_s[i]);
-		server.rx_flag[i](tx_flag_s[i]);
-		server.rx_data[i](tx_data_s[i]);
-	}
-	server.fifo_data[0](fifo_data_robot1);
-	server.fifo_data[1](fifo_data_robot2);
-	server.fifo_data[2](fifo_data_robot3);
-	server.fifo_data[3](fifo_data_robot4);
+	//CHANNELS
+	sc_signal<bool>* server_tx_ack = rx_ack_s;				//what each sender binds to, moved in front
+	sc_signal<bool>* server_tx_flag = rx_flag_s;				//of a link_channel if its link is impaired
+	sc_signal<frame_word>* server_tx_data = rx_data_s;
+	sc_signal<bool>* robot_tx_ack_s = tx_ack_s;
+	sc_signal<bool>* robot_tx_flag_s = tx_flag_s;
+	sc_signal<frame_word>* robot_tx_data_s = tx_data_s;
+	sc_signal<bool>* processing_tx_ack = rx_ack_p;
+	sc_signal<bool>* processing_tx_flag = rx_flag_p;
+	sc_signal<frame_word>* processing_tx_data = rx_data_p;
+	sc_signal<bool>* robot_tx_ack_p = tx_ack_p;
+	sc_signal<bool>* robot_tx_flag_p = tx_flag_p;
+	sc_signal<frame_word>* robot_tx_data_p = tx_data_p;
+	auto impair = [&](int link, const char* name, sc_signal<bool>*& ack, sc_signal<bool>*& flag, sc_signal<frame_word>*& data) {
+		if (!channels.params(link).impaired) {
+			return;
+		}
+		link_channel<NUM_OF_ROBOTS>* channel = new link_channel<NUM_OF_ROBOTS>(name, channels.params(link), channels.seed(link));
+		sc_signal<bool>* sender_ack = new sc_signal<bool>[NUM_OF_ROBOTS];
+		sc_signal<bool>* sender_flag = new sc_signal<bool>[NUM_OF_ROBOTS];
+		sc_signal<frame_word>* sender_data = new sc_signal<frame_word>[NUM_OF_ROBOTS];
+		for (int i = 0; i < NUM_OF_ROBOTS; i++) {
+			channel->rx_ack[i](sender_ack[i]);
+			channel->rx_flag[i](sender_flag[i]);
+			channel->rx_data[i](sender_data[i]);
+			channel->tx_ack[i](ack[i]);			//the receiver keeps the traced signals
+			channel->tx_flag[i](flag[i]);
+			channel->tx_data[i](data[i]);
+		}
+		ack = sender_ack;
+		flag = sender_flag;
+		data = sender_data;
+	};
+	data_channel* data_link = 0;
+	if (partition != COSIM_PROCESSING) {	//the robots and the server's end of the data path live here
+		impair(CHANNEL_SERVER_ROBOT, "server-robot", server_tx_ack, server_tx_flag, server_tx_data);
+		impair(CHANNEL_ROBOT_SERVER, "robot-server", robot_tx_ack_s, robot_tx_flag_s, robot_tx_data_s);
+		impair(CHANNEL_PROCESSING_ROBOT, "processing-robot", processing_tx_ack, processing_tx_flag, processing_tx_data);
+		impair(CHANNEL_ROBOT_PROCESSING, "robot-processing", robot_tx_ack_p, robot_tx_flag_p, robot_tx_data_p);
+		if (channels.params(CHANNEL_SERVER_DATA).impaired) {
+			data_link = new data_channel(channels.params(CHANNEL_SERVER_DATA), channels.seed(CHANNEL_SERVER_DATA), NUM_OF_ROBOTS,
+										 channels.ack_timeout() > 0 ? channels.ack_timeout() : LINK_ACK_TIMEOUT);
+		}
+	}
 	
-	robot robots[NUM_OF_ROBOTS] = {{"Robot_1"}, {"Robot_2"}, {"Robot_3"}, {"Robot_4"}};
-	for (int i = 0; i < NUM_OF_ROBOTS; i++) {
-		robots[i].clock(clock);
-		robots[i].tx_ack_p(tx_ack_p[i]);
-		robots[i].tx_flag_p(tx_flag_p[i]);
-		robots[i].tx_data_p(tx_data_p[i]);
-		robots[i].rx_ack_p(rx_ack_p[i]);
-		robots[i].rx_flag_p(rx_flag_p[i]);
-		robots[i].rx_data_p(rx_data_p[i]);
-		robots[i].tx_ack_s(tx_ack_s[i]);
-		robots[i].tx_flag_s(tx_flag_s[i]);
-		robots[i].tx_data_s(tx_data_s[i]);
-		robots[i].rx_ack_s(rx_ack_s[i]);
-		robots[i].rx_flag_s(rx_flag_s[i]);
-		robots[i].rx_data_s(rx_data_s[i]);
+    //MODULES
+	typedef processing<MAP_SIZE_X, MAP_SIZE_Y, GRID_SIZE_SCALED, NUM_OF_ROBOTS, NUM_OF_OBSTACLES, PATH_LENGTH, map_type> processing_module;
+	typedef server<MAP_SIZE_X, MAP_SIZE_Y, NUM_OF_ROBOTS, PATH_LENGTH, map_type> server_module;
+	auto bind_processing_side = [&](auto& module) {		//ports of processing's end of the robot links
+		for (int i = 0; i < NUM_OF_ROBOTS; i++) {
+			module.tx_ack[i](processing_tx_ack[i]);
+			module.tx_flag[i](processing_tx_flag[i]);
+			module.tx_data[i](processing_tx_data[i]);
+			module.rx_ack[i](tx_ack_p[i]);
+			module.rx_flag[i](tx_flag_p[i]);
+			module.rx_data[i](tx_data_p[i]);
+		}
+	};
+	sc_trace_file* speed = 0;
+	processing_module* processing = 0;
+	server_module* server = 0;
+	robot* robots[NUM_OF_ROBOTS] = {0};
+	cosim_link<NUM_OF_ROBOTS>* link = 0;					//other partition's end of the robot links
+	if (partition != COSIM_SERVER) {
+		speed = sc_create_vcd_trace_file("robot_trace");
+		processing = new processing_module("processing", module_map, (const int*) obstacle_path, obstacle_kinds.data(), speed, telemetry_ptr, kpi_ptr, hash_ptr, threads, trace_ptr);
+		processing->clock(clock);
+		bind_processing_side(*processing);
+		for (int i = 0; i < NUM_OF_ROBOTS; i++) {
+			processing->fifo_data[i](*fifo_data[i]);
+		}
+	}
+	if (partition != COSIM_PROCESSING) {
+		server = new server_module("processing", module_map, &graph, &zones, (const int*) robot_path, path_release, (const int*) node_order, NUM_NODE_ORDERS, speed_policy, telemetry_ptr, kpi_ptr, hash_ptr, data_link, trace_ptr);
+		server->clock(clock);
+		for (int i = 0; i < NUM_OF_ROBOTS; i++) {
+			server->tx_ack[i](server_tx_ack[i]);
+			server->tx_flag[i](server_tx_flag[i]);
+			server->tx_data[i](server_tx_data[i]);
+			server->rx_ack[i](tx_ack_s[i]);
+			server->rx_flag[i](tx_flag_s[i]);
+			server->rx_data[i](tx_data_s[i]);
+			server->fifo_data[i](*fifo_data[i]);
+		}
+		
+		for (int i = 0; i < NUM_OF_ROBOTS; i++) {
+			robots[i] = new robot(("Robot_" + std::to_string(i+1)).c_str(), i, trace_ptr);
+			robots[i]->clock(clock);
+			robots[i]->tx_ack_p(robot_tx_ack_p[i]);
+			robots[i]->tx_flag_p(robot_tx_flag_p[i]);
+			robots[i]->tx_data_p(robot_tx_data_p[i]);
+			robots[i]->rx_ack_p(rx_ack_p[i]);
+			robots[i]->rx_flag_p(rx_flag_p[i]);
+			robots[i]->rx_data_p(rx_data_p[i]);
+			robots[i]->tx_ack_s(robot_tx_ack_s[i]);
+			robots[i]->tx_flag_s(robot_tx_flag_s[i]);
+			robots[i]->tx_data_s(robot_tx_data_s[i]);
+			robots[i]->rx_ack_s(rx_ack_s[i]);
+			robots[i]->rx_flag_s(rx_flag_s[i]);
+			robots[i]->rx_data_s(rx_data_s[i]);
+		}
+	}
+	if (partition == COSIM_SERVER) {
+		link = new cosim_link<NUM_OF_ROBOTS>("processing_link");	//stands in for processing
+		bind_processing_side(*link);
+	}
+	else if (partition == COSIM_PROCESSING) {
+		link = new cosim_link<NUM_OF_ROBOTS>("robot_link");		//stands in for the robots
+		for (int i = 0; i < NUM_OF_ROBOTS; i++) {
+			link->tx_ack[i](tx_ack_p[i]);
+			link->tx_flag[i](tx_flag_p[i]);
+			link->tx_data[i](tx_data_p[i]);
+			link->rx_ack[i](rx_ack_p[i]);
+			link->rx_flag[i](rx_flag_p[i]);
+			link->rx_data[i](rx_data_p[i]);
+		}
 	}
 	
-	stimulus<2700> stimulus("stim");
+	stimulus<SIM_TIME/20> stimulus("stim");
 	stimulus.clock(clock);
+	realtime_pacer* pacer = 0;
+	if (realtime > 0 && partition != COSIM_PROCESSING) {	//the other partition keeps pace through the exchanges
+		pacer = new realtime_pacer("pacer", sc_time(10, SC_MS), realtime);	//one clock
+	}
 
     //TRACES
-    sc_trace_file* tf = sc_create_vcd_trace_file("sim_trace");
+    sc_trace_file* tf = (partition == COSIM_PROCESSING) ? 0 : sc_create_vcd_trace_file("sim_trace");
     sc_trace(tf, clock, "clock");
-    for (int i = 0; i < NUM_OF_ROBOTS; i++) {
+    for (int i = 0; tf && i < NUM_OF_ROBOTS; i++) {
 		char num = i + '0';
     	sc_trace(tf, tx_ack_s[i], "tx_ack_from_server" + std::to_string(i+1));
     	sc_trace(tf, tx_flag_s[i], "tx_flag_to_server" + std::to_string(i+1));
@@ -160,10 +436,58 @@ int sc_main(int argc, char* argv[]) {
 	}
 	
 
+	if (hash_ptr && !hash.open(hash_file, hash_interval)) {	//after the modules registered their state
+		cout << "Error: could not write state hashes to " << hash_file << endl;
+		return 1;
+	}
+
     //START SIM
-    sc_start(((2700)*2)*10, SC_MS);
-    sc_close_vcd_trace_file(tf);
-	sc_close_vcd_trace_file(speed);
+	if (partition == -1) {
+		PROFILE_RUN(sc_start(SIM_TIME, SC_MS));
+	}
+	else {
+		auto run_windows = [&]() {				//exchanges between windows count as run time
+			for (int window = 1; window*COSIM_WINDOW <= SIM_TIME; window++) {
+				sc_start(COSIM_WINDOW, SC_MS);
+				if (!partitions.exchange(window, *link)) {
+					cout << "Error: the other partition stopped at " << sc_time_stamp() << endl;
+					break;
+				}
+			}
+		};
+		PROFILE_RUN(run_windows());
+	}
+	hash.close();
+	if (tf) {
+		sc_close_vcd_trace_file(tf);
+	}
+	if (speed) {
+		sc_close_vcd_trace_file(speed);
+	}
+	PROFILE_REPORT(partition == COSIM_PROCESSING ? "profile_processing.json" : "profile.json");
+	if (kpi_ptr && !kpi.write(kpi_prefix)) {
+		cout << "Error: could not write " << kpi_prefix << ".csv/.json" << endl;
+	}
+	if (kpi_ptr && channels_file && !channel_model::write((std::string(kpi_prefix) + "_channels.csv").c_str())) {
+		cout << "Error: could not write " << kpi_prefix << "_channels.csv" << endl;
+	}
+	if (links_file && !link_health::write(links_file)) {
+		cout << "Error: could not write link counters to " << links_file << endl;
+	}
+	if (trace_ptr && !trace.write(latency_file)) {
+		cout << "Error: could not write status latencies to " << latency_file << endl;
+	}
+	if (pacer) {
+		cout << "Realtime x" << realtime << ": " << pacer->misses() << " of " << pacer->ticks() << " ticks missed their deadline, see " << REALTIME_REPORT << endl;
+		if (!pacer->write(REALTIME_REPORT)) {
+			cout << "Error: could not write " << REALTIME_REPORT << endl;
+		}
+	}
+	if (partition == COSIM_PROCESSING) {
+		cout.flush();
+		_exit(0);							//the telemetry region and map belong to the server partition
+	}
+	partitions.finish();
 
     return 0;
 }
@@ -0,0 +1,234 @@
+#ifndef MAP_FILE_CPP
+#define MAP_FILE_CPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include "path_codec.cpp"
+
+#define MAP_FILE_VERSION 1
+
+//Binary map layout, all sections 8 byte aligned:
+//	header
+//	walkable bits	one bit per cell, row-major (y*size_x + x)
+//	grid table		int32 grid number per cell, -1 for blocked cells
+//	grid x table	int32 map x coordinate per grid number (index 0 unused)
+//	grid y table	int32 map y coordinate per grid number
+//	adjacency		4 x int32 per grid number: neighbour grid (PATH_RIGHT/LEFT/UP/DOWN) or -1
+typedef struct Map_Header {
+	char magic[4];				//"WMAP"
+	uint32_t version;
+	uint32_t size_x;
+	uint32_t size_y;
+	uint32_t num_grids;			//highest grid number
+	uint64_t walkable_offset;
+	uint64_t grid_offset;
+	uint64_t grid_x_offset;
+	uint64_t grid_y_offset;
+	uint64_t adjacency_offset;
+	uint64_t file_size;
+}Map_Header;
+
+static inline uint64_t map_align(uint64_t offset) {
+	return (offset + 7) & ~(uint64_t)7;
+}
+
+//write a map given as a row-major int array (-1 = blocked) to a binary map file
+static inline bool map_file_write(const char* file_name, const int* map, int size_x, int size_y) {
+	Map_Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "WMAP", 4);
+	header.version = MAP_FILE_VERSION;
+	header.size_x = size_x;
+	header.size_y = size_y;
+	for (int i = 0; i < size_x*size_y; i++) {
+		if (map[i] > (int)header.num_grids) {
+			header.num_grids = map[i];
+		}
+	}
+	uint64_t cells = (uint64_t)size_x*size_y;
+	uint64_t grids = (uint64_t)header.num_grids + 1;
+	header.walkable_offset = map_align(sizeof(Map_Header));
+	header.grid_offset = map_align(header.walkable_offset + (cells + 7)/8);
+	header.grid_x_offset = map_align(header.grid_offset + cells*4);
+	header.grid_y_offset = map_align(header.grid_x_offset + grids*4);
+	header.adjacency_offset = map_align(header.grid_y_offset + grids*4);
+	header.file_size = map_align(header.adjacency_offset + grids*16);
+
+	std::vector<char> data(header.file_size, 0);
+	uint8_t* walkable = (uint8_t*)&data[header.walkable_offset];
+	int32_t* grid = (int32_t*)&data[header.grid_offset];
+	int32_t* grid_x = (int32_t*)&data[header.grid_x_offset];
+	int32_t* grid_y = (int32_t*)&data[header.grid_y_offset];
+	int32_t* adjacency = (int32_t*)&data[header.adjacency_offset];
+	for (uint64_t i = 0; i < grids; i++) {
+		grid_x[i] = grid_y[i] = -1;
+		adjacency[i*4 + PATH_RIGHT] = adjacency[i*4 + PATH_LEFT] = -1;
+		adjacency[i*4 + PATH_UP] = adjacency[i*4 + PATH_DOWN] = -1;
+	}
+	for (int y = 0; y < size_y; y++) {
+		for (int x = 0; x < size_x; x++) {
+			int id = map[y*size_x + x];
+			grid[y*size_x + x] = id;
+			if (id < 0) {
+				continue;
+			}
+			walkable[(y*size_x + x)/8] |= 1 << ((y*size_x + x) % 8);
+			grid_x[id] = x;
+			grid_y[id] = y;
+			if (x + 1 < size_x) adjacency[id*4 + PATH_RIGHT] = map[y*size_x + x + 1];
+			if (x > 0) adjacency[id*4 + PATH_LEFT] = map[y*size_x + x - 1];
+			if (y + 1 < size_y) adjacency[id*4 + PATH_UP] = map[(y + 1)*size_x + x];
+			if (y > 0) adjacency[id*4 + PATH_DOWN] = map[(y - 1)*size_x + x];
+		}
+	}
+	memcpy(&data[0], &header, sizeof(header));
+
+	FILE* file = fopen(file_name, "wb");
+	if (file == NULL) {
+		return false;
+	}
+	bool written = fwrite(&data[0], 1, data.size(), file) == data.size();
+	return (fclose(file) == 0) && written;
+}
+
+//Read-only view of a binary map file. The file is mmap'ed once and every
+//module reads the same pages, so there is a single copy of the map in memory.
+class map_view {
+	public:
+		map_view():_base(0), _length(0), _header(0) {}
+
+		~map_view() {
+			close();
+		}
+
+		bool open(const char* file_name) {
+			close();
+			int fd = ::open(file_name, O_RDONLY);
+			if (fd == -1) {
+				return false;
+			}
+			struct stat info;
+			if (fstat(fd, &info) == -1 || (uint64_t)info.st_size < sizeof(Map_Header)) {
+				::close(fd);
+				return false;
+			}
+			void* base = mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd);								//mapping stays valid without the descriptor
+			if (base == MAP_FAILED) {
+				return false;
+			}
+			_base = (const char*)base;
+			_length = info.st_size;
+			_header = (const Map_Header*)_base;
+			if (memcmp(_header->magic, "WMAP", 4) != 0 || _header->version != MAP_FILE_VERSION ||
+				_header->file_size > _length || !valid()) {
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		void close() {
+			if (_base) {
+				munmap((void*)_base, _length);
+			}
+			_base = 0;
+			_header = 0;
+		}
+
+		int size_x() const { return _header->size_x; }
+		int size_y() const { return _header->size_y; }
+		int num_grids() const { return _header->num_grids; }
+
+		bool walkable(int x, int y) const {
+			int cell = y*_header->size_x + x;
+			return (_walkable[cell/8] >> (cell % 8)) & 1;
+		}
+
+		int grid(int x, int y) const {			//grid number at map xy, -1 if blocked
+			return _grid[y*_header->size_x + x];
+		}
+
+		int grid_x(int grid) const {			//map xy coordinate of a grid number, -1 if unknown
+			return (grid < 0 || grid > (int)_header->num_grids) ? -1 : _grid_x[grid];
+		}
+
+		int grid_y(int grid) const {
+			return (grid < 0 || grid > (int)_header->num_grids) ? -1 : _grid_y[grid];
+		}
+
+		int neighbour(int grid, int direction) const {
+			return _adjacency[grid*4 + direction];
+		}
+
+		const int* grid_x_table() const { return (const int*)_grid_x; }
+		const int* grid_y_table() const { return (const int*)_grid_y; }
+
+	private:
+		const char* _base;
+		uint64_t _length;
+		const Map_Header* _header;
+		const uint8_t* _walkable;
+		const int32_t* _grid;
+		const int32_t* _grid_x;
+		const int32_t* _grid_y;
+		const int32_t* _adjacency;
+
+		//section lies inside the mapping, int32 sections 4 byte aligned
+		bool section_fits(uint64_t offset, uint64_t size, uint64_t align) const {
+			return offset >= sizeof(Map_Header) && offset % align == 0 &&
+				   offset <= _length && size <= _length - offset;
+		}
+
+		//every section inside the file and every stored grid number and
+		//coordinate in range, so no accessor can read past the mapping
+		bool valid() {
+			uint64_t size_x = _header->size_x;
+			uint64_t size_y = _header->size_y;
+			uint64_t num_grids = _header->num_grids;
+			if (size_x == 0 || size_y == 0 || size_x > 0xFFFF || size_y > 0xFFFF || num_grids > 0x7FFFFFFE) {
+				return false;
+			}
+			uint64_t cells = size_x*size_y;
+			uint64_t grids = num_grids + 1;
+			if (!section_fits(_header->walkable_offset, (cells + 7)/8, 1) ||
+				!section_fits(_header->grid_offset, cells*4, 4) ||
+				!section_fits(_header->grid_x_offset, grids*4, 4) ||
+				!section_fits(_header->grid_y_offset, grids*4, 4) ||
+				!section_fits(_header->adjacency_offset, grids*16, 4)) {
+				return false;
+			}
+			_walkable = (const uint8_t*)(_base + _header->walkable_offset);
+			_grid = (const int32_t*)(_base + _header->grid_offset);
+			_grid_x = (const int32_t*)(_base + _header->grid_x_offset);
+			_grid_y = (const int32_t*)(_base + _header->grid_y_offset);
+			_adjacency = (const int32_t*)(_base + _header->adjacency_offset);
+			for (uint64_t i = 0; i < cells; i++) {
+				if (_grid[i] < -1 || _grid[i] > (int64_t)num_grids) {
+					return false;
+				}
+			}
+			for (uint64_t i = 0; i < grids; i++) {
+				if (_grid_x[i] < -1 || _grid_x[i] >= (int64_t)size_x || _grid_y[i] < -1 || _grid_y[i] >= (int64_t)size_y) {
+					return false;
+				}
+			}
+			for (uint64_t i = 0; i < grids*4; i++) {
+				if (_adjacency[i] < -1 || _adjacency[i] > (int64_t)num_grids) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		map_view(const map_view&);
+		map_view& operator=(const map_view&);
+};
+
+#endif
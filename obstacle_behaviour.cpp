@@ -0,0 +1,181 @@
+#ifndef OBSTACLE_BEHAVIOUR_CPP
+#define OBSTACLE_BEHAVIOUR_CPP
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "map_file.cpp"
+#include "seeded_random.cpp"
+
+#define OBSTACLE_SPEED 4000			//4000 mm/s
+#define OBSTACLE_CART_SPEED 2000	//random walk, mm/s
+#define OBSTACLE_FORKLIFT_SPEED 2500
+#define OBSTACLE_FORKLIFT_STOP 3	//one in this many grids is a stop to load or unload
+#define OBSTACLE_FORKLIFT_DWELL 100	//clocks, a stop lasts 1 to 3 times this
+#define OBSTACLE_WALKER_SPEED 1000	//slowest walking pace, mm/s
+#define OBSTACLE_WALKER_SPREAD 800	//pace is picked again at every grid, up to this much faster
+#define OBSTACLE_WALKER_PAUSE 8		//one in this many grids the walker stops for a while
+#define OBSTACLE_WALKER_TURN 10		//one in this many grids the walker turns back
+
+enum {OBSTACLE_CYCLIC, OBSTACLE_RANDOM_WALK, OBSTACLE_FORKLIFT, OBSTACLE_WALKER, OBSTACLE_KINDS};
+
+//Obstacle behaviours for processing, picked per obstacle with -obstacle-mix.
+//Each behaviour is a policy class that processing is instantiated with, so the
+//per-clock step is one inlined loop per kind over the obstacles of that kind and
+//no obstacle pays for a virtual call. A behaviour decides three things:
+//	speed(o)			distance moved this clock, 0 while stopped
+//	next_grid(o, map)	grid after o.next_grid, chosen as the obstacle enters it
+//	arrived(o)			called when the obstacle reaches a grid centre
+//The base provides path following and the shared state handling, behaviours
+//override what they do differently. Everything a behaviour touches is in its
+//own obstacle, so obstacles can be stepped on any thread in any order.
+template<class behaviour> class obstacle_behaviour {
+	public:
+		template<class obstacle> static int speed(obstacle& o) {
+			if (o.timer > 0) {
+				o.timer--;
+				return 0;
+			}
+			return behaviour::pace(o);
+		}
+
+		template<class obstacle, class map_type> static int next_grid(obstacle& o, const map_type*) {
+			return path_next(o, 1);
+		}
+
+		template<class obstacle> static void arrived(obstacle&) {}
+
+		template<class obstacle> static int pace(obstacle& o) {
+			return o.pace;
+		}
+
+	protected:
+		template<class obstacle> static int path_next(obstacle& o, int direction) {	//-1 past either end of the path
+			const int length = sizeof(o.path)/sizeof(o.path[0]);
+			if (direction > 0) {
+				for (int i = 0; i < length - 1; i++) {
+					if (o.path[i] == o.next_grid) {
+						return o.path[i+1];
+					}
+				}
+			}
+			else {
+				for (int i = length - 1; i > 0; i--) {
+					if (o.path[i] == o.next_grid) {
+						return o.path[i-1];
+					}
+				}
+			}
+			return -1;
+		}
+
+		template<class obstacle> static int shuttle(obstacle& o) {	//along the path, back again at its ends
+			int grid = path_next(o, o.direction);
+			if (grid == -1) {
+				o.direction = -o.direction;
+				grid = o.current_grid;
+			}
+			return grid;
+		}
+
+		template<class obstacle> static uint32_t random(obstacle& o) {	//per obstacle
+			return splitmix64(o.random) >> 32;
+		}
+};
+
+//Fixed cyclic path at constant speed, the original obstacle.
+class cyclic_path:public obstacle_behaviour<cyclic_path> {
+	public:
+		template<class obstacle> static int speed(obstacle&) {
+			return OBSTACLE_SPEED;
+		}
+};
+
+//Cart pushed around at random: any open neighbour but the grid it came from.
+class random_walk:public obstacle_behaviour<random_walk> {
+	public:
+		template<class obstacle, class map_type> static int next_grid(obstacle& o, const map_type* map) {
+			int options[4];
+			int count = 0;
+			for (int direction = PATH_RIGHT; direction <= PATH_DOWN; direction++) {
+				int grid = map->neighbour(o.next_grid, direction);
+				if (grid != -1 && grid != o.current_grid) {
+					options[count++] = grid;
+				}
+			}
+			return count ? options[random(o) % count] : o.current_grid;		//dead end, back out
+		}
+
+		template<class obstacle> static int pace(obstacle&) {
+			return OBSTACLE_CART_SPEED;
+		}
+};
+
+//Forklift shuttling along its path, stopping at some grids to load or unload.
+class forklift:public obstacle_behaviour<forklift> {
+	public:
+		template<class obstacle, class map_type> static int next_grid(obstacle& o, const map_type*) {
+			return shuttle(o);
+		}
+
+		template<class obstacle> static void arrived(obstacle& o) {
+			if (random(o) % OBSTACLE_FORKLIFT_STOP == 0) {
+				o.timer = OBSTACLE_FORKLIFT_DWELL*(1 + random(o) % 3);
+			}
+		}
+
+		template<class obstacle> static int pace(obstacle&) {
+			return OBSTACLE_FORKLIFT_SPEED;
+		}
+};
+
+//Person walking the path at a changing pace, who stops now and then and
+//sometimes turns back.
+class walker:public obstacle_behaviour<walker> {
+	public:
+		template<class obstacle, class map_type> static int next_grid(obstacle& o, const map_type*) {
+			if (random(o) % OBSTACLE_WALKER_TURN == 0) {
+				o.direction = -o.direction;
+				return o.current_grid;
+			}
+			return shuttle(o);
+		}
+
+		template<class obstacle> static void arrived(obstacle& o) {
+			o.pace = OBSTACLE_WALKER_SPEED + random(o) % OBSTACLE_WALKER_SPREAD;
+			if (random(o) % OBSTACLE_WALKER_PAUSE == 0) {
+				o.timer = 50 + random(o) % 150;		//0.5 to 2 s
+			}
+		}
+};
+
+//kinds of a comma separated list such as "cyclic,walker", assigned to the
+//obstacles in turn; false on an unknown name
+static inline bool obstacle_mix(const char* list, int obstacles, std::vector<int>& kinds) {
+	const char* names[OBSTACLE_KINDS] = {"cyclic", "random", "forklift", "walker"};
+	std::vector<int> mix;
+	while (*list) {
+		int length = strcspn(list, ",");
+		int kind = -1;
+		for (int k = 0; k < OBSTACLE_KINDS; k++) {
+			if ((int)strlen(names[k]) == length && strncmp(list, names[k], length) == 0) {
+				kind = k;
+			}
+		}
+		if (kind == -1) {
+			return false;
+		}
+		mix.push_back(kind);
+		list += length + (list[length] == ',');
+	}
+	if (mix.empty()) {
+		return false;
+	}
+	kinds.resize(obstacles);
+	for (int i = 0; i < obstacles; i++) {
+		kinds[i] = mix[i % mix.size()];
+	}
+	return true;
+}
+
+#endif
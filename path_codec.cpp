@@ -0,0 +1,112 @@
+#ifndef PATH_CODEC_CPP
+#define PATH_CODEC_CPP
+
+#define PATH_SEGMENT 8			//path cells sent per segment
+#define PATH_LOOKAHEAD 8		//server tops up a route when fewer cells than this are left ahead of the robot
+#define PATH_WINDOW 20			//run words buffered per robot in processing (>= PATH_SEGMENT + PATH_LOOKAHEAD + 1)
+
+//Routes travel as a start cell followed by run-length direction steps.
+//A step word holds the direction in the low two bits and the run length above that.
+//Path message on the data link: { 11, start grid (-1 for a continuation), last segment, steps... }
+enum {PATH_RIGHT = 0, PATH_LEFT = 1, PATH_UP = 2, PATH_DOWN = 3};
+
+static inline int path_direction(int x, int y, int next_x, int next_y) {
+	if (next_x > x) {
+		return PATH_RIGHT;
+	}
+	else if (next_x < x) {
+		return PATH_LEFT;
+	}
+	else if (next_y > y) {
+		return PATH_UP;
+	}
+	else {
+		return PATH_DOWN;
+	}
+}
+
+//encode the steps path[first] -> ... -> path[last], returns the number of step words
+static inline int path_encode(const int* path, int first, int last, const int* grid_x, const int* grid_y, int* steps, int max_steps) {
+	int n = 0;
+	for (int i = first; i < last; i++) {
+		int dir = path_direction(grid_x[path[i]], grid_y[path[i]], grid_x[path[i+1]], grid_y[path[i+1]]);
+		if (n > 0 && (steps[n-1] & 3) == dir) {
+			steps[n-1] += 4;					//extend the current run
+		}
+		else if (n < max_steps) {
+			steps[n++] = 4 | dir;				//start a new run of one cell
+		}
+		else {
+			break;
+		}
+	}
+	return n;
+}
+
+//Bounded decoder for one robot's route, fed segment by segment.
+class path_stream {
+	public:
+		path_stream() {
+			start(-1, -1);
+		}
+
+		void start(int x, int y) {
+			_x = x;
+			_y = y;
+			_head = 0;
+			_count = 0;
+			_left = 0;
+			_last = false;
+		}
+
+		bool push(const int* steps, int n, bool last) {
+			if (_count + n > PATH_WINDOW) {
+				return false;
+			}
+			for (int i = 0; i < n; i++) {
+				_steps[(_head + _count + i) % PATH_WINDOW] = steps[i];
+			}
+			_count += n;
+			_last = last;
+			return true;
+		}
+
+		//1: stepped to (x, y), 0: end of route, -1: next segment has not arrived yet
+		int next(int& x, int& y) {
+			if (_left == 0) {
+				if (_count == 0) {
+					return _last ? 0 : -1;
+				}
+				_dir = _steps[_head] & 3;
+				_left = _steps[_head] >> 2;
+				_head = (_head + 1) % PATH_WINDOW;
+				_count--;
+			}
+			switch (_dir) {
+				case PATH_RIGHT: _x++; break;
+				case PATH_LEFT: _x--; break;
+				case PATH_UP: _y++; break;
+				default: _y--; break;
+			}
+			_left--;
+			x = _x;
+			y = _y;
+			return 1;
+		}
+
+		int free() const {
+			return PATH_WINDOW - _count;
+		}
+
+	private:
+		int _steps[PATH_WINDOW];
+		int _head;
+		int _count;
+		int _x;				//last cell handed out
+		int _y;
+		int _dir;			//run being walked
+		int _left;
+		bool _last;			//final segment received
+};
+
+#endif
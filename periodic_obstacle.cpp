@@ -0,0 +1,147 @@
+#ifndef PERIODIC_OBSTACLE_CPP
+#define PERIODIC_OBSTACLE_CPP
+
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "path_codec.cpp"
+
+//Movement of an obstacle through one grid, the same for every grid: the steps
+//from a grid centre to the next one at a constant speed. Made by running the
+//rules of processing::obstacle_move along one axis, so a closed form built on it
+//lands on exactly the positions the stepped obstacle would.
+class obstacle_profile {
+	public:
+		obstacle_profile():_period(0), _crossing(0) {}
+
+		void init(int speed, int grid_size) {
+			int centre = grid_size/2;
+			int u = centre;							//along the direction of travel
+			int status = 0;
+			_along.assign(1, u);
+			_status.assign(1, status);
+			_crossing = 0;
+			while (true) {
+				if (status != 2) {
+					if (u + speed > grid_size) {	//into the next grid
+						u += speed - grid_size;
+						status = 2;
+						_crossing = _along.size();
+					}
+					else {
+						u += speed;
+					}
+				}
+				else {
+					u += (u < centre) ? std::min(speed, centre - u) : -std::min(speed, u - centre);
+					if (u == centre) {
+						break;						//at the next centre, the period starts again
+					}
+				}
+				_along.push_back(u);
+				_status.push_back(status);
+			}
+			_period = _along.size();
+		}
+
+		int period() const { return _period; }			//steps from one grid centre to the next
+		int crossing() const { return _crossing; }		//steps from a centre until the obstacle is in the next grid
+		int along(int phase) const { return _along[phase]; }
+		int status(int phase) const { return _status[phase]; }
+
+	private:
+		int _period;
+		int _crossing;
+		std::vector<int> _along;
+		std::vector<int> _status;
+};
+
+//Closed form of a cyclic obstacle: its grid, position and status after any
+//number of steps, from where it is in its path and in the grid profile, in O(1).
+//The grids it passes are worked out once the way obstacle_update_grid() walks
+//the path (the first place a grid is listed decides what comes after it), as a
+//lead-in followed by a loop. Paths that end or stall are not periodic and keep
+//being stepped.
+class periodic_obstacle {
+	public:
+		periodic_obstacle():_lead(0), _loop(0) {}
+
+		template<class map_type> bool init(const int* path, int path_length, const map_type* map) {
+			std::map<int, int> seen;				//grid -> place in _grids
+			int grid = path[0];
+			while (grid != -1 && seen.find(grid) == seen.end()) {
+				seen[grid] = _grids.size();
+				_grids.push_back(grid);
+				int next = -1;
+				for (int i = 0; i < path_length - 1; i++) {
+					if (path[i] == grid) {
+						next = path[i+1];
+						break;
+					}
+				}
+				grid = next;
+			}
+			if (grid == -1) {
+				return false;
+			}
+			_lead = seen[grid];
+			_loop = _grids.size() - _lead;
+			for (int k = 0; k < (int)_grids.size(); k++) {
+				int from = _grids[k];
+				int to = at(k + 1);
+				int x = map->grid_x(from), y = map->grid_y(from);
+				int to_x = map->grid_x(to), to_y = map->grid_y(to);
+				if (x == -1 || to_x == -1) {
+					return false;
+				}
+				_direction.push_back(to_x < x ? PATH_LEFT : to_x > x ? PATH_RIGHT : to_y < y ? PATH_DOWN : to_y > y ? PATH_UP : -1);
+				if (_direction.back() == -1) {
+					return false;					//stays on its grid, never moves
+				}
+			}
+			return true;
+		}
+
+		const std::vector<int>& grids() const { return _grids; }	//every grid it ever passes
+
+		int grid(int64_t steps, const obstacle_profile& profile) const {	//current grid after steps
+			int64_t k = steps/profile.period();
+			return at(k + (steps % profile.period() >= profile.crossing()));
+		}
+
+		//full state after steps, written into an obstacle of processing
+		template<class obstacle> void state(int64_t steps, const obstacle_profile& profile, int grid_size, obstacle& o) const {
+			int64_t k = steps/profile.period();
+			int phase = steps % profile.period();
+			int crossed = phase >= profile.crossing();
+			int direction = _direction[place(k)];
+			int along = profile.along(phase);
+			o.status = profile.status(phase);
+			o.current_grid = at(k + crossed);
+			o.next_grid = at(k + crossed + 1);
+			o.position_x = o.position_y = grid_size/2;
+			switch (direction) {
+				case PATH_RIGHT: o.position_x = along; break;
+				case PATH_LEFT: o.position_x = grid_size - along; break;
+				case PATH_UP: o.position_y = along; break;
+				case PATH_DOWN: o.position_y = grid_size - along; break;
+			}
+		}
+
+	private:
+		std::vector<int> _grids;				//lead-in, then one loop
+		std::vector<int> _direction;			//from each grid to the one after it
+		int _lead;
+		int _loop;
+
+		int place(int64_t k) const {
+			return (k < _lead) ? k : _lead + (k - _lead) % _loop;
+		}
+
+		int at(int64_t k) const {
+			return _grids[place(k)];
+		}
+};
+
+#endif
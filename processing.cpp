@@ -1,66 +1,74 @@
 #include "systemc.h"
+#include "bulk_fifo.cpp"
+#include "path_codec.cpp"
+#include "map_file.cpp"
+#include "static_map.cpp"
+#include "telemetry.cpp"
+#include "profiler.cpp"
+#include "kpi.cpp"
+#include "state_hash.cpp"
+#include "link_health.cpp"
+#include "frame.cpp"
+#include "dirty_set.cpp"
+#include "worker_pool.cpp"
+#include "obstacle_behaviour.cpp"
+#include "periodic_obstacle.cpp"
+#include "latency_trace.cpp"
 
-#define OBSTACLE_SPEED 4000		//4000 mm/s
 #define ROBOT_SPEED_MAX 2000	//2000 mm/s
+#define STEP_PARTITION 64		//agents per partition unit, a multiple of 64 keeps partitions on separate cache lines
 
-template<int map_size_x, int map_size_y, int grid_size, int num_of_robots, int num_of_obstacles> class processing:public sc_module {
+template<int map_size_x, int map_size_y, int grid_size, int num_of_robots, int num_of_obstacles, int path_length,
+		 class map_type = map_view> class processing:public sc_module {
 	public:
 		//PORTS
 		sc_in<bool> clock;
 		sc_in<bool> tx_ack[num_of_robots];
 		sc_out<bool> tx_flag[num_of_robots];
-		sc_out<sc_uint<16> > tx_data[num_of_robots];
+		sc_out<frame_word> tx_data[num_of_robots];
 		sc_out<bool> rx_ack[num_of_robots];
 		sc_in<bool> rx_flag[num_of_robots];
-		sc_in<sc_uint<16> > rx_data[num_of_robots];
-		sc_fifo_in<int> fifo_data[num_of_robots];
+		sc_in<frame_word> rx_data[num_of_robots];
+		bulk_fifo_in<int> fifo_data[num_of_robots];
 		
 		//CONSTRUCTOR
 		SC_HAS_PROCESS(processing);
 		
-		processing(sc_module_name name, const int* map_ptr, const int* obstacle_path_ptr, sc_trace_file* tf_ptr):
-		sc_module(name), _map_ptr(map_ptr), _obstacle_path_ptr(obstacle_path_ptr) , tf(tf_ptr){
+		processing(sc_module_name name, const map_type* map, const int* obstacle_path_ptr, const int* obstacle_kind_ptr, sc_trace_file* tf_ptr,
+				   telemetry_publisher* telemetry, kpi_collector* kpi, state_hasher* hash, int threads = 1, latency_trace* trace = 0):
+		sc_module(name), _map(map), _obstacle_path_ptr(obstacle_path_ptr) , _health("processing", num_of_robots), tf(tf_ptr), _telemetry(telemetry), _kpi(kpi), _hash(hash),
+		_pool(threads > 1 ? new worker_pool(threads) : 0), _trace(trace){
 			SC_METHOD(prc_update);
 			sensitive << clock.pos();
 			
 			SC_THREAD(prc_tx);
-			sensitive << tx_ack[0].pos() << tx_ack[1].pos() << tx_ack[2].pos() << tx_ack[3].pos();
 			
 			SC_THREAD(prc_rx);
-			sensitive << rx_flag[0].pos() << rx_flag[1].pos() << rx_flag[2].pos() << rx_flag[3].pos();
-
-			for (int x = 0; x < map_size_x; x++) {
-				for (int y = 0; y < map_size_y; y++) {
-					_map_data[x][y] = *(_map_ptr + y*map_size_x + x);	//store map data locally
-				}
+			for (int i = 0; i < num_of_robots; i++) {
+				sensitive << rx_flag[i].pos();
 			}
+
 			for (int i = 0; i < num_of_obstacles; i++) {		//initialize all obstacles
 				_obstacles[i].status = 0;
 				_obstacles[i].position_x = grid_size/2;
 				_obstacles[i].position_y = grid_size/2;
 				_obstacles[i].speed = OBSTACLE_SPEED;
-				for (int o = 0; o < 23; o++) {
-					_obstacles[i].path[o] = *(_obstacle_path_ptr + i*23 + o);
+				_obstacles[i].kind = obstacle_kind_ptr ? obstacle_kind_ptr[i] : OBSTACLE_CYCLIC;
+				_obstacles[i].pace = OBSTACLE_WALKER_SPEED;
+				_obstacles[i].timer = 0;
+				_obstacles[i].direction = 1;
+				_obstacles[i].random = i + 1;
+				for (int o = 0; o < path_length; o++) {
+					_obstacles[i].path[o] = *(_obstacle_path_ptr + i*path_length + o);
 				}
 				_obstacles[i].current_grid = _obstacles[i].path[0];
 				_obstacles[i].next_grid = _obstacles[i].path[1];
-				for (int x = 0; x < map_size_x; x++) {
-					for (int y = 0; y < map_size_y; y++) {
-						//store the map xy coordinate of the grids
-						if (_obstacles[i].current_grid == _map_data[x][y]) {
-							_obstacles[i].current_grid_map_x = x;
-							_obstacles[i].current_grid_map_y = y;
-						}
-						if (_obstacles[i].next_grid == _map_data[x][y]) {
-							_obstacles[i].next_grid_map_x = x;
-							_obstacles[i].next_grid_map_y = y;
-						}
-					}
-				}
+				_obstacles[i].current_grid_map_x = _map->grid_x(_obstacles[i].current_grid);	//store the map xy coordinate of the grids
+				_obstacles[i].current_grid_map_y = _map->grid_y(_obstacles[i].current_grid);
+				_obstacles[i].next_grid_map_x = _map->grid_x(_obstacles[i].next_grid);
+				_obstacles[i].next_grid_map_y = _map->grid_y(_obstacles[i].next_grid);
 			}
 			for (int i = 0; i < num_of_robots; i++) {			//initialize all robots
-				_robot_path[i][0] = -1;
-				
 				_robots[i].position_x = grid_size/2;			//init robots to center of grid
 				_robots[i].position_y = grid_size/2;
 				_robots[i].speed = 0;					//init robot speed to 0 (default for phase 2)
@@ -79,18 +87,67 @@ template<int map_size_x, int map_size_y, int grid_size, int num_of_robots, int n
 				_rx_table[i].modified = false;
 				
 				_fifo_data_index[i] = -1;
+				_fifo_data_length[i] = 0;
+				_robot_blocker[i] = -1;
+				_speed_due[i] = 0;
+				_path_due[i] = 0;
+				_speed_tag[i] = 0;
+				_health.name_link(i, "Robot_" + std::to_string(i+1));
+			}
+			_profile.init(OBSTACLE_SPEED, grid_size);
+			_lazy_on_grid.resize(_map->num_grids() + 1);
+			for (int i = 0; i < num_of_obstacles; i++) {		//cyclic obstacles are worked out when needed
+				_lazy[i] = _obstacles[i].kind == OBSTACLE_CYCLIC && _periodic[i].init(_obstacles[i].path, path_length, _map);
+				const std::vector<int>& grids = _periodic[i].grids();
+				for (int g = 0; _lazy[i] && g < (int)grids.size(); g++) {
+					_lazy_on_grid[grids[g]].push_back(i);
+				}
+			}
+			_obstacle_steps = 0;
+			_obstacles_synced = 0;
+			int stepped = 0;
+			for (int k = 0; k < OBSTACLE_KINDS; k++) {		//the others are stepped in batches of one kind
+				_kind_begin[k] = stepped;
+				for (int i = 0; i < num_of_obstacles; i++) {
+					if (_obstacles[i].kind == k && !_lazy[i]) {
+						_obstacle_order[stepped++] = i;
+					}
+				}
+			}
+			_kind_begin[OBSTACLE_KINDS] = stepped;
+			for (int i = 0; i < num_of_obstacles; i++) {
+				if (!_lazy[i]) {
+					_stepped.push_back(i);
+				}
+			}
+			_obstacle_partition = step_partition(stepped);
+			_robot_partition = step_partition(num_of_robots);
+
+			if (_hash) {
+				const char* fields[HASH_FIELDS] = {"processing.position_x", "processing.position_y", "processing.speed",
+					"processing.status", "processing.prev_status", "processing.current_grid", "processing.next_grid",
+					"processing.token_index", "processing.token_length", "processing.tx_status"};
+				for (int k = 0; k < HASH_FIELDS; k++) {
+					_hash_field[k] = _hash->add_field(fields[k]);
+				}
+				for (int i = 0; i < num_of_robots; i++) {
+					_hash_robot[i] = _hash->add_agent("robot_" + std::to_string(i+1));
+				}
+				for (int i = 0; i < num_of_obstacles; i++) {
+					_hash_obstacle[i] = _hash->add_agent("obstacle_" + std::to_string(i+1));
+				}
 			}
-			_tx_counter = 0;
-			_rx_counter = 0;
 
-			sc_trace(tf, _robots[0].speed, "robot_1_speed");
-			sc_trace(tf, _robots[1].speed, "robot_2_speed");
-			sc_trace(tf, _robots[2].speed, "robot_3_speed");
-			sc_trace(tf, _robots[3].speed, "robot_4_speed");
-			sc_trace(tf, _main_table[0].current_grid, "robot_1_current_grid");
-			sc_trace(tf, _main_table[1].current_grid, "robot_2_current_grid");
-			sc_trace(tf, _main_table[2].current_grid, "robot_3_current_grid");
-			sc_trace(tf, _main_table[3].current_grid, "robot_4_current_grid");
+			for (int i = 0; i < num_of_robots; i++) {
+				sc_trace(tf, _robots[i].speed, "robot_" + std::to_string(i+1) + "_speed");
+			}
+			for (int i = 0; i < num_of_robots; i++) {
+				sc_trace(tf, _main_table[i].current_grid, "robot_" + std::to_string(i+1) + "_current_grid");
+			}
+		}
+
+		~processing() {
+			delete _pool;
 		}
 
 	private:
@@ -130,297 +187,489 @@ template<int map_size_x, int map_size_y, int grid_size, int num_of_robots, int n
 			int next_grid;
 			int next_grid_map_x;
 			int next_grid_map_y;
-			int path[23];
+			int kind;			//behaviour, see obstacle_behaviour.cpp
+			int pace;			//speed when not stopped, for behaviours that change it
+			int timer;			//clocks left standing still
+			int direction;		//1 along the path, -1 back
+			uint64_t random;	//behaviour's own random sequence
+			int path[path_length];
 		}Obstacle;
+
+		typedef struct Robot_Step {	//effects of a parallel robot step, applied in the commit phase
+			int tx_status;		//status to send to the robot, -1 if none
+			int speed_report;	//speed after a speed token was used, -1 if none
+			bool speed_tick;	//speed data was taken up at this speed tick
+		}Robot_Step;
 		
-		const int* _map_ptr;						//pointer to map data
-		int _map_data[map_size_x][map_size_y];		//locally stored map data
-		int _robot_path[num_of_robots][23];			//parameterized robots path (hard-coded for phase 1)
+		const map_type* _map;						//shared read-only map, or the one baked in
+		path_stream _robot_path[num_of_robots];		//part of each robots path that has been received
 		const int* _obstacle_path_ptr;				//pointer to obstacle path data
-		Obstacle _obstacles[num_of_obstacles];		//array of all obstacles
-		Robot _robots[num_of_robots];				//array of all robots
-		Robot_Main_Status _main_table[num_of_robots];
+		alignas(64) Obstacle _obstacles[num_of_obstacles];		//array of all obstacles
+		int _obstacle_order[num_of_obstacles];		//stepped obstacle numbers sorted by kind
+		int _kind_begin[OBSTACLE_KINDS + 1];		//first place of each kind in _obstacle_order
+		std::vector<int> _stepped;					//stepped obstacle numbers, ascending
+		bool _lazy[num_of_obstacles];				//not stepped, state from _periodic when needed
+		periodic_obstacle _periodic[num_of_obstacles];
+		obstacle_profile _profile;
+		std::vector<std::vector<int> > _lazy_on_grid;	//lazy obstacles that pass each grid, ascending
+		int64_t _obstacle_steps;					//obstacle steps so far
+		int64_t _obstacles_synced;					//steps when _obstacles last had the lazy ones written in
+		alignas(64) Robot _robots[num_of_robots];				//array of all robots
+		alignas(64) Robot_Main_Status _main_table[num_of_robots];
+		alignas(64) Robot_Step _robot_step[num_of_robots];
 		
-		int _tx_counter;
-		int _rx_counter;
+		dirty_set<num_of_robots> _tx_dirty;			//robots with statuses to send
+		dirty_set<num_of_robots> _rx_dirty;			//robots with received statuses to handle
 		Robot_Status _tx_table[num_of_robots];
 		Robot_Status _rx_table[num_of_robots];
+		frame_queue _tx_queue[num_of_robots];		//statuses for the next frame to each robot
+		frame_queue _rx_queue[num_of_robots];		//statuses received since the last clock
 		sc_event tx_signal;
+		link_health _health;						//handshake retries on the robot links
 
 		int _clock_count = -1;
-		int _fifo_data[num_of_robots][80];
-		int _fifo_data_index[num_of_robots];
+		alignas(64) int _fifo_data[num_of_robots][80];
+		alignas(64) int _fifo_data_index[num_of_robots];
+		alignas(64) int _fifo_data_length[num_of_robots];
+		alignas(64) int _robot_blocker[num_of_robots];	//obstacle last found in the robots way, -1 if none
+		alignas(64) int _speed_due[num_of_robots];		//SPEED statuses in whose data has not been read yet
+		alignas(64) int _path_due[num_of_robots];		//PATH statuses in whose first segment has not been read yet
 
 		sc_trace_file* tf;
+		telemetry_publisher* _telemetry;			//live state feed, 0 if disabled
+		kpi_collector* _kpi;						//fleet performance figures, 0 if disabled
+		state_hasher* _hash;						//per tick state hashes, 0 if disabled
+		enum {HASH_POSITION_X, HASH_POSITION_Y, HASH_SPEED, HASH_STATUS, HASH_PREV_STATUS, HASH_CURRENT_GRID,
+			  HASH_NEXT_GRID, HASH_TOKEN_INDEX, HASH_TOKEN_LENGTH, HASH_TX_STATUS, HASH_FIELDS};
+		int _hash_field[HASH_FIELDS];
+		int _hash_robot[num_of_robots];
+		int _hash_obstacle[num_of_obstacles];
+		worker_pool* _pool;							//parallel step threads, 0 for a serial step
+		latency_trace* _trace;						//status latencies, 0 if disabled
+		int _speed_tag[num_of_robots];				//trace tag of the SPEED waiting for its speed tick, 0 if none
+		int _obstacle_partition;					//agents per parallel task
+		int _robot_partition;
 
 		//PROCESS
 		void prc_tx() {
+			PROFILE_THREAD("processing::prc_tx");
 			while (1) {
-				wait(tx_signal);
-				while (_tx_counter > 0) {					//if recieved data
-					for (int i = 0; i < num_of_robots; i++) {	//loop through tx table
-						if (_tx_table[i].modified) {
-							tx_flag[i] = 1;						//set tx flag
-							tx_data[i] = _tx_table[i].status;	//write data to tx channel
-							wait();								//wait for ack bit from robot
-							if (tx_ack[i] == 1) {
-								_tx_table[i].modified = false;	//if ack was found,
-								_tx_counter--;					//decrement tx_counter
-							}
-							tx_flag[i] = 0;						//clear tx flag
-							wait(SC_ZERO_TIME);
-							break;					//note: if ack was not recieved,
-						}							//process will keep sending until successful
+				PROFILE_WAIT(wait(tx_signal));
+				while (!_tx_dirty.empty()) {				//statuses waiting to be sent
+					int i = next_tx();
+					if (i == num_of_robots) {
+						sc_time retry = next_retry();
+						if (retry == SC_ZERO_TIME) {		//nothing waiting
+							_tx_dirty.clear();
+							break;
+						}
+						PROFILE_WAIT(wait(retry - sc_time_stamp(), tx_signal));	//every waiting word is backing off
+						continue;
+					}
+					int sent = _tx_queue[i].framed();		//statuses in this frame
+					tx_flag[i] = 1;						//set tx flag
+					tx_data[i] = _tx_queue[i].word();	//write frame to tx channel
+					for (int k = 0; _trace && k < sent; k++) {
+						_trace->stamp(i, _tx_queue[i].tag(k), _tx_queue[i].status(k), TRACE_SENT);
+					}
+					_health.sent(i);
+					PROFILE_WAIT(wait(_health.timeout(), tx_ack[i].posedge_event()));	//wait for ack bit from robot
+					if (tx_ack[i] == 1) {
+						_health.acked(i);
+						_tx_queue[i].acked(sent);		//if ack was found,
+					}
+					else if (!_health.timed_out(i)) {	//otherwise try again after a backoff,
+						_tx_queue[i].clear();			//or give the frame up on a dead link
 					}
+					if (_tx_queue[i].empty() && _tx_table[i].modified) {
+						_tx_table[i].modified = false;	//everything sent
+						_tx_dirty.erase(i);
+					}
+					tx_flag[i] = 0;						//clear tx flag
+					PROFILE_WAIT(wait(SC_ZERO_TIME));
+				}
+			}
+		}
+		
+		int next_tx() {								//first robot with a word and a link ready for it
+			for (int i = _tx_dirty.first(); i != -1; i = _tx_dirty.next(i)) {
+				if (_health.ready(i)) {
+					return i;
+				}
+			}
+			return num_of_robots;
+		}
+		
+		sc_time next_retry() {						//earliest a waiting word can be tried again, 0 if none waits
+			sc_time first = SC_ZERO_TIME;
+			for (int i = _tx_dirty.first(); i != -1; i = _tx_dirty.next(i)) {
+				if (first == SC_ZERO_TIME || _health.retry_at(i) < first) {
+					first = _health.retry_at(i);
 				}
 			}
+			return first;
+		}
+		
+		void send_status(int robot, int status, int grid = FRAME_NONE, int speed = FRAME_NONE) {
+			_tx_table[robot].status = status;
+			_tx_table[robot].modified = 1;
+			_tx_dirty.insert(robot);
+			int tag = _trace ? _trace->open(robot, TRACE_PROCESSING, status) : 0;
+			_tx_queue[robot].push(status, grid, speed, tag);	//goes out with anything else still queued
 		}
 		
 		void prc_rx() {
+			PROFILE_THREAD("processing::prc_rx");
 			while(1) {
-				wait();
+				PROFILE_WAIT(wait());
 				for (int i = 0; i < num_of_robots; i++) {
 					if (rx_flag[i] == 1) {
 						rx_ack[i] = 1;								//send ack bit
-						_rx_table[i].status = rx_data[i].read();	//update rx table
-						_rx_table[i].modified = 1;
-						wait(SC_ZERO_TIME);
+						bool waiting = !_rx_queue[i].empty();
+						int first = _rx_queue[i].size();
+						if (_rx_queue[i].receive(rx_data[i].read()) > 0 && !waiting) {	//new statuses, not a repeat
+							_rx_table[i].modified = 1;				//update rx table
+							_rx_dirty.insert(i);
+						}
+						for (int k = first; _trace && k < _rx_queue[i].size(); k++) {
+							_trace->stamp(i, _rx_queue[i].tag(k), _rx_queue[i].status(k), TRACE_RECEIVED);
+						}
+						PROFILE_WAIT(wait(SC_ZERO_TIME));
 						rx_ack[i] = 0;
-						_rx_counter++;
 					}
 				}
 			}
 		}
 		
 		void prc_update() {
-			while (_rx_counter > 0) {					//if recieved data
-				for (int i = 0; i < num_of_robots; i++) {	//loop through rx table
-					if (_rx_table[i].modified) {
-						int data = -1;
-						switch(_rx_table[i].status) {
-							case 5:
-								_main_table[i].prev_status = _main_table[i].status;
-								_main_table[i].status = 1;
+			PROFILE_PROCESS("processing::prc_update");
+			for (int i = _rx_dirty.first(); i != -1; i = _rx_dirty.next(i)) {	//robots with received statuses, in robot order
+				for (int k = 0; k < _rx_queue[i].size(); k++) {		//statuses in the order they were sent
+					_rx_table[i].status = _rx_queue[i].status(k);
+					if (_trace && _rx_table[i].status == 10) {
+						_speed_tag[i] = _rx_queue[i].tag(k);	//takes effect at the next speed tick
+					}
+					else if (_trace) {
+						_trace->applied(i, _rx_queue[i].tag(k), _rx_table[i].status);
+					}
+					switch(_rx_table[i].status) {
+						case 5:
+							if (_main_table[i].status == 3) {		//stopped since it asked: crossing once it is resumed
+								_main_table[i].prev_status = 1;
 								break;
-							case 6:
+							}
+							_main_table[i].prev_status = _main_table[i].status;
+							_main_table[i].status = 1;
+							break;
+						case 6:
+							_main_table[i].prev_status = _main_table[i].status;
+							_main_table[i].status = 0;
+							break;
+						case 7:
+						case 8:
+							if (_main_table[i].status != 3) {
 								_main_table[i].prev_status = _main_table[i].status;
-								_main_table[i].status = 0;
-								break;
-							case 7:
-							case 8:
-								if (_main_table[i].status != 3) {
-									_main_table[i].prev_status = _main_table[i].status;
-								}
-								_main_table[i].status = 3;
-								_main_table[i].speed = 0;
-								_robots[i].speed = 0;
-								break;
-							case 9:
-								_main_table[i].status = _main_table[i].prev_status;
-								break;
-							case 10:
-								if (_fifo_data_index[i] != -1) {
-									for (int o = 0; o < 80; o++) {
-										if (_fifo_data[i][o] == -1) {
-											fifo_data[i].nb_read(data);
-											if (data == -1) {
-												break;
-											}
-											_fifo_data[i][o] = data;
-											_fifo_data[i][o+1] = -1;
-										}
-									}
-								}
-								else {
-									for (int o = 0; o < 80; o++) {
-										fifo_data[i].nb_read(data);
-										_fifo_data[i][o] = data;
-										if (_fifo_data[i][o] == -1) {
-											break;
-										}
-									}
-									_fifo_data_index[i] = 0;
-								}
-								break;
-							case 11:
-								for (int o = 0; o < 23; o++) {
-									fifo_data[i].nb_read(data);
-									_robot_path[i][o] = data;	//store robot path data locally
-									if (_robot_path[i][o] == -1) {
-										break;
-									}
-								}
-								_main_table[i].current_grid = _robot_path[i][0];
-								_main_table[i].next_grid = _robot_path[i][1];
-								for (int x = 0; x < map_size_x; x++) {
-									for (int y = 0; y < map_size_y; y++) {
-										//store the map xy coordinate of the grids
-										if (_main_table[i].current_grid == _map_data[x][y]) {
-											_main_table[i].current_grid_map_x = x;
-											_main_table[i].current_grid_map_y = y;
-										}
-										if (_main_table[i].next_grid == _map_data[x][y]) {
-											_main_table[i].next_grid_map_x = x;
-											_main_table[i].next_grid_map_y = y;
-										}
-									}
-								}
-								_main_table[i].status = 0;
-								_main_table[i].prev_status = 3;
-								break;
-							default:
-								break;
-						}
-						_rx_counter--;
-						_rx_table[i].modified = 0;
+							}
+							_main_table[i].status = 3;
+							_main_table[i].speed = 0;
+							_robots[i].speed = 0;
+							_fifo_data_index[i] = -1;			//speed tokens not used yet are dropped, as in speed_schedule::stopped()
+							break;
+						case 9:
+							_main_table[i].status = _main_table[i].prev_status;
+							break;
+						case 10:
+							_speed_due[i]++;
+							receive_data(i, 10);
+							break;
+						case 11:
+							_path_due[i]++;
+							receive_data(i, 11);				//first segment sets the current grid
+							break;
+						default:
+							break;
 					}
 				}
+				_rx_queue[i].clear();
+				_rx_dirty.erase(i);
+				_rx_table[i].modified = 0;
 			}
 			
 			
-			for (int i = 0; i < num_of_obstacles; i++) {
-				bool obstacle_moved = obstacle_move(i);
-				switch (_obstacles[i].status) {
-					case 0:								//STATE: RESUME
-						if (obstacle_moved) {
-							_obstacles[i].status = 2;	//update status to crossed
-						}
-						break;
-					case 2:								//STATE: CROSSED
-						if (obstacle_moved) {
-							_obstacles[i].status = 0;	//update status to resume
-						}
-						break;
-					default:
-						break;
-				}
-			}
+			//COMPUTE: every agent only touches its own state, robots read the obstacles moved before them
+			step(_kind_begin[OBSTACLE_KINDS], _obstacle_partition, obstacle_task);
+			_obstacle_steps++;
+			step(num_of_robots, _robot_partition, robot_task);
+
+			//COMMIT: shared effects in robot order, the same for any number of threads
 			for (int i = 0; i < num_of_robots; i++) {
-				//SPEED UPDATES
-				if (_clock_count % 10 == 0) {			//speed updates every 0.1 s
-					if (_fifo_data_index[i] != -1) {	//if there is still speed data from fifo
-						if (_fifo_data[i][_fifo_data_index[i]] == 2) {
-							_robots[i].speed += 100;	//increase speed by 100 mm/s
-							_main_table[i].speed += 50;
-							_fifo_data_index[i]++;
-						}
-						else if (_fifo_data[i][_fifo_data_index[i]] == 1) {
-							_robots[i].speed -= 50;		//decrease speed by 50 mm/s
-							_main_table[i].speed -= 50;
-							_fifo_data_index[i]++;
-						}
-						else {
-							_fifo_data_index[i] = -1;	//end of fifo speed data
-						}
-						
-						if (_fifo_data_index[i] != -1) {
-							cout << "TIME: " << sc_time_stamp() << " | "
-								 << "Robot_" << (i+1) << " speed is now " << _robots[i].speed << " mm/s" << endl;
-						}
-					}
+				if (_robot_step[i].speed_report != -1) {
+					cout << "TIME: " << sc_time_stamp() << " | "
+						 << "Robot_" << (i+1) << " speed is now " << _robot_step[i].speed_report << " mm/s" << endl;
 				}
-				
-				//POSITION UPDATES
-				bool robot_moved = robot_move(i);
-				switch (_main_table[i].status) {
-					case 0:								//STATE: RESUME
-						if (robot_moved) {
-							if (_robots[i].position_x <= grid_size/10 ||
-							_robots[i].position_x >= grid_size - (grid_size/10) ||
-							_robots[i].position_y <= grid_size/10 ||
-							_robots[i].position_y >= grid_size - (grid_size/10)) {
-								_tx_table[i].status = 2;
-								_tx_table[i].modified = true;
-								_tx_counter++;
-							}
-						}
-						else {
-							_main_table[i].prev_status = _main_table[i].status;
-							_main_table[i].status = 3;		//update status to stopped
-							_main_table[i].speed = 0;
-							_robots[i].speed = 0;
-							_fifo_data_index[i] = -1;
-							_tx_table[i].status = 0;
-							_tx_table[i].modified = true;
-							_tx_counter++;
-						}
-						break;
-					case 1:								//STATE: CROSSING
-						if (robot_moved) {
-							if (_main_table[i].modified) {
-								_main_table[i].prev_status = _main_table[i].status;
-								_main_table[i].modified = 0;
-								_main_table[i].status = 2;	//update status to crossed
-								_tx_table[i].status = 4;
-								_tx_table[i].modified = true;
-								_tx_counter++;
-							}
-						}
-						else {
-							_main_table[i].prev_status = _main_table[i].status;
-							_main_table[i].status = 3;		//update status to stopped
-							_main_table[i].speed = 0;
-							_robots[i].speed = 0;
-							_fifo_data_index[i] = -1;
-							_tx_table[i].status = 0;
-							_tx_table[i].modified = true;
-							_tx_counter++;
-						}
-						break;
-					case 2:								//STATE: CROSSED
-						if (robot_moved) {
-							if (_robots[i].position_x <= (grid_size/2 + ROBOT_SPEED_MAX) &&
-								_robots[i].position_x >= (grid_size/2 - ROBOT_SPEED_MAX) &&
-								_robots[i].position_y <= (grid_size/2 + ROBOT_SPEED_MAX) &&
-								_robots[i].position_y >= (grid_size/2 - ROBOT_SPEED_MAX)) {
-									_main_table[i].prev_status = _main_table[i].status;
-									_main_table[i].status = 0;	//update status to resume
-							}
-						}
-						else {
-							_main_table[i].prev_status = _main_table[i].status;
-							_main_table[i].status = 3;			//update status to stopped
-							_main_table[i].speed = 0;
-							_robots[i].speed = 0;
-							_fifo_data_index[i] = -1;
-							_tx_table[i].status = 0;
-							_tx_table[i].modified = true;
-							_tx_counter++;
-						}
-						break;
-					case 3:								//STATE: STOPPED
-						if (robot_moved) {
-							_tx_table[i].status = 1;
-							_tx_table[i].modified = true;
-							_tx_counter++;
-						}
-						else {
-							_fifo_data_index[i] = -1;
-						}
-						break;
-					default:
-						break;
+				if (_robot_step[i].tx_status != -1) {
+					send_status(i, _robot_step[i].tx_status, _main_table[i].current_grid);
+				}
+				if (_trace && _robot_step[i].speed_tick && _speed_tag[i] != 0) {
+					_trace->applied(i, _speed_tag[i], 10);
+					_speed_tag[i] = 0;
 				}
 			}
 
-			if (_tx_counter > 0) {
+			if (!_tx_dirty.empty()) {
 				tx_signal.notify(SC_ZERO_TIME);
 				cout << endl;
 				print_stat();
 
 			}
+			if (_telemetry) {
+				publish_telemetry();
+			}
+			if (_kpi) {
+				for (int i = 0; i < num_of_robots; i++) {
+					_kpi->robot_state(i, _main_table[i].status, _robots[i].speed);
+				}
+			}
 
 			_clock_count++;
+			if (_hash) {
+				hash_state();
+			}
+		}
+
+		int step_partition(int agents) {
+			int threads = _pool ? _pool->size() : 1;
+			int size = std::max((agents + threads - 1)/threads, 1);
+			return (size + STEP_PARTITION - 1)/STEP_PARTITION*STEP_PARTITION;
+		}
+
+		void step(int agents, int partition, void (*task)(void*, int)) {
+			int tasks = (agents + partition - 1)/partition;
+			if (_pool) {
+				_pool->run(tasks, task, this);
+			}
+			else {
+				for (int t = 0; t < tasks; t++) {
+					task(this, t);
+				}
+			}
+		}
+
+		static void obstacle_task(void* context, int task) {
+			processing* self = (processing*)context;
+			int begin = task*self->_obstacle_partition;
+			int end = std::min(begin + self->_obstacle_partition, num_of_obstacles);
+			self->obstacle_batch<cyclic_path>(OBSTACLE_CYCLIC, begin, end);
+			self->obstacle_batch<random_walk>(OBSTACLE_RANDOM_WALK, begin, end);
+			self->obstacle_batch<forklift>(OBSTACLE_FORKLIFT, begin, end);
+			self->obstacle_batch<walker>(OBSTACLE_WALKER, begin, end);
+		}
+
+		template<class behaviour> void obstacle_batch(int kind, int begin, int end) {	//places begin..end of one kind
+			int first = std::max(begin, _kind_begin[kind]);
+			int last = std::min(end, _kind_begin[kind + 1]);
+			for (int k = first; k < last; k++) {
+				obstacle_step<behaviour>(_obstacle_order[k]);
+			}
+		}
+
+		static void robot_task(void* context, int task) {
+			processing* self = (processing*)context;
+			int end = std::min((task + 1)*self->_robot_partition, num_of_robots);
+			for (int i = task*self->_robot_partition; i < end; i++) {
+				self->robot_step(i);
+			}
+		}
+
+		template<class behaviour> void obstacle_step(int i) {
+			_obstacles[i].speed = behaviour::speed(_obstacles[i]);
+			bool obstacle_moved = obstacle_move<behaviour>(i);
+			switch (_obstacles[i].status) {
+				case 0:								//STATE: RESUME
+					if (obstacle_moved) {
+						_obstacles[i].status = 2;	//update status to crossed
+					}
+					break;
+				case 2:								//STATE: CROSSED
+					if (obstacle_moved) {
+						_obstacles[i].status = 0;	//update status to resume
+						behaviour::arrived(_obstacles[i]);
+					}
+					break;
+				default:
+					break;
+			}
+		}
+
+		//one robot's tick, may run on a worker thread: no SystemC calls, no shared writes
+		void robot_step(int i) {
+			_robot_step[i].tx_status = -1;
+			_robot_step[i].speed_report = -1;
+			_robot_step[i].speed_tick = false;
+			if (robot_idle(i)) {
+				return;
+			}
+			receive_data(i, -1);					//pick up streamed path segments
+			
+			//SPEED UPDATES
+			if (_clock_count % 10 == 0) {			//speed updates every 0.1 s
+				if (_fifo_data_index[i] != -1) {	//if there is still speed data from fifo
+					_robot_step[i].speed_tick = true;
+					if (_fifo_data_index[i] == _fifo_data_length[i]) {
+						_fifo_data_index[i] = -1;	//end of fifo speed data
+					}
+					else if (_fifo_data[i][_fifo_data_index[i]] == 2) {
+						_robots[i].speed += 100;	//increase speed by 100 mm/s
+						_main_table[i].speed += 50;
+						_fifo_data_index[i]++;
+					}
+					else if (_fifo_data[i][_fifo_data_index[i]] == 1) {
+						_robots[i].speed -= 50;		//decrease speed by 50 mm/s
+						_main_table[i].speed -= 50;
+						_fifo_data_index[i]++;
+					}
+					else {
+						_fifo_data_index[i] = -1;	//end of fifo speed data
+					}
+					
+					if (_fifo_data_index[i] != -1) {
+						_robot_step[i].speed_report = _robots[i].speed;
+					}
+				}
+			}
+			
+			//POSITION UPDATES
+			bool robot_moved = robot_move(i);
+			switch (_main_table[i].status) {
+				case 0:								//STATE: RESUME
+					if (robot_moved) {
+						if (_robots[i].position_x <= grid_size/10 ||
+						_robots[i].position_x >= grid_size - (grid_size/10) ||
+						_robots[i].position_y <= grid_size/10 ||
+						_robots[i].position_y >= grid_size - (grid_size/10)) {
+							_robot_step[i].tx_status = 2;
+						}
+					}
+					else {
+						_main_table[i].prev_status = _main_table[i].status;
+						_main_table[i].status = 3;		//update status to stopped
+						_main_table[i].speed = 0;
+						_robots[i].speed = 0;
+						_fifo_data_index[i] = -1;
+						_robot_step[i].tx_status = 0;
+					}
+					break;
+				case 1:								//STATE: CROSSING
+					if (robot_moved) {
+						if (_main_table[i].modified) {
+							_main_table[i].prev_status = _main_table[i].status;
+							_main_table[i].modified = 0;
+							_main_table[i].status = 2;	//update status to crossed
+							_robot_step[i].tx_status = 4;
+						}
+					}
+					else {
+						_main_table[i].prev_status = _main_table[i].status;
+						_main_table[i].status = 3;		//update status to stopped
+						_main_table[i].speed = 0;
+						_robots[i].speed = 0;
+						_fifo_data_index[i] = -1;
+						_robot_step[i].tx_status = 0;
+					}
+					break;
+				case 2:								//STATE: CROSSED
+					if (robot_moved) {
+						if (_robots[i].position_x <= (grid_size/2 + ROBOT_SPEED_MAX) &&
+							_robots[i].position_x >= (grid_size/2 - ROBOT_SPEED_MAX) &&
+							_robots[i].position_y <= (grid_size/2 + ROBOT_SPEED_MAX) &&
+							_robots[i].position_y >= (grid_size/2 - ROBOT_SPEED_MAX)) {
+								_main_table[i].prev_status = _main_table[i].status;
+								_main_table[i].status = 0;	//update status to resume
+						}
+					}
+					else {
+						_main_table[i].prev_status = _main_table[i].status;
+						_main_table[i].status = 3;			//update status to stopped
+						_main_table[i].speed = 0;
+						_robots[i].speed = 0;
+						_fifo_data_index[i] = -1;
+						_robot_step[i].tx_status = 0;
+					}
+					break;
+				case 3:								//STATE: STOPPED
+					if (robot_moved) {
+						_robot_step[i].tx_status = 1;
+					}
+					else {
+						_fifo_data_index[i] = -1;
+					}
+					break;
+				default:
+					break;
+			}
 		}
 		
-		bool robot_move(int robot) {
-			int obstacle;
-			for (obstacle = 0; obstacle < num_of_obstacles; obstacle++) {
-				if (_obstacles[obstacle].current_grid == _main_table[robot].next_grid ||
-					_obstacles[obstacle].current_grid == _main_table[robot].current_grid) {
+		//A step that cannot change anything: the robot waits for its first path, or is
+		//stopped with an obstacle in its way, and has no path or speed data to take in.
+		//It drops out of the step until a message, data or the obstacle moving re-arms it.
+		bool robot_idle(int i) {
+			if (_fifo_data_index[i] != -1 || fifo_data[i].peek_length() != -1) {
+				return false;
+			}
+			if (_main_table[i].status == 4) {
+				return true;
+			}
+			int obstacle = _robot_blocker[i];
+			return _main_table[i].status == 3 && obstacle != -1 &&
+				   (obstacle_grid(obstacle) == _main_table[i].next_grid ||
+					obstacle_grid(obstacle) == _main_table[i].current_grid);
+		}
+		
+		int obstacle_grid(int obstacle) const {
+			return _lazy[obstacle] ? _periodic[obstacle].grid(_obstacle_steps, _profile) : _obstacles[obstacle].current_grid;
+		}
+		
+		int find_obstacle(int next_grid, int current_grid) const {	//lowest obstacle on either grid, num_of_obstacles if none
+			int found = num_of_obstacles;
+			for (int k = 0; k < (int)_stepped.size(); k++) {
+				int i = _stepped[k];
+				if (_obstacles[i].current_grid == next_grid || _obstacles[i].current_grid == current_grid) {
+					found = i;
 					break;
 				}
 			}
+			const int grids[2] = {next_grid, current_grid};
+			for (int g = 0; g < 2; g++) {		//only the lazy ones that ever pass the grid
+				if (grids[g] < 0 || grids[g] >= (int)_lazy_on_grid.size()) {
+					continue;
+				}
+				const std::vector<int>& candidates = _lazy_on_grid[grids[g]];
+				for (int c = 0; c < (int)candidates.size() && candidates[c] < found; c++) {
+					if (_periodic[candidates[c]].grid(_obstacle_steps, _profile) == grids[g]) {
+						found = candidates[c];
+						break;
+					}
+				}
+			}
+			return found;
+		}
+		
+		void sync_obstacles() {						//lazy obstacles' state into _obstacles, for output
+			if (_obstacles_synced == _obstacle_steps) {
+				return;
+			}
+			for (int i = 0; i < num_of_obstacles; i++) {
+				if (_lazy[i]) {
+					_periodic[i].state(_obstacle_steps, _profile, grid_size, _obstacles[i]);
+				}
+			}
+			_obstacles_synced = _obstacle_steps;
+		}
+		
+		bool robot_move(int robot) {
+			PROFILE_FUNCTION("processing::robot_move");
+			int obstacle = find_obstacle(_main_table[robot].next_grid, _main_table[robot].current_grid);
+			_robot_blocker[robot] = (obstacle == num_of_obstacles) ? -1 : obstacle;
 
 			if (_main_table[robot].status != 2) {		//if robot is not CROSSED, we need to move towards the middle, regardles of next grid
 				//MOVE LEFT
@@ -544,58 +793,110 @@ template<int map_size_x, int map_size_y, int grid_size, int num_of_robots, int n
 		}
 		
 		bool table_update_grid(int robot) {
-			int new_next_grid = -1;
-			//search for next grid in path
-			for (int i = 0; i < 23; i++) {
-				if (_robot_path[robot][i] == _main_table[robot].next_grid) {
-					new_next_grid = _robot_path[robot][i+1];
-					break;
-				}
+			int x, y;
+			int new_next_grid = path_next_grid(robot, x, y);		//next grid in path
+			if (new_next_grid == -2) {
+				return false;								//rest of the path has not arrived yet, wait here
 			}
 			
 			//write new grids into table (only if robot hasn't reached end of path)
 			if (new_next_grid != -1) {
+				_main_table[robot].current_grid_map_x = _main_table[robot].next_grid_map_x;
+				_main_table[robot].current_grid_map_y = _main_table[robot].next_grid_map_y;
 				_main_table[robot].current_grid = _main_table[robot].next_grid;
 				_main_table[robot].next_grid = new_next_grid;
-				for (int x = 0; x < map_size_x; x++) {
-					for (int y = 0; y < map_size_y; y++) {
-						//store the map xy coordinate of the grids
-						if (_main_table[robot].current_grid == _map_data[x][y]) {
-							_main_table[robot].current_grid_map_x = x;
-							_main_table[robot].current_grid_map_y = y;
-						}
-						if (_main_table[robot].next_grid == _map_data[x][y]) {
-							_main_table[robot].next_grid_map_x = x;
-							_main_table[robot].next_grid_map_y = y;
-						}
-					}
-				}
+				_main_table[robot].next_grid_map_x = x;
+				_main_table[robot].next_grid_map_y = y;
 				_main_table[robot].modified = true;
 				return true;
 			}
 			else {
+				if (_main_table[robot].status != 1) {
+					return false;							//no OK1 for the last grid yet, wait at the edge
+				}
 				_main_table[robot].current_grid_map_x = _main_table[robot].next_grid_map_x;
 				_main_table[robot].current_grid_map_y = _main_table[robot].next_grid_map_y;
 				_main_table[robot].current_grid = _main_table[robot].next_grid;
 				_main_table[robot].next_grid = -1;
-				if (_main_table[robot].status == 1) {		//Edge case for when robot reaches last grid in path
-					_main_table[robot].modified = 1;
-					return true;
+				_main_table[robot].modified = 1;			//Edge case for when robot reaches last grid in path
+				return true;
+			}
+		}
+
+		int path_next_grid(int robot, int& x, int& y) {		//-1: end of path, -2: waiting for the next segment
+			int result = _robot_path[robot].next(x, y);
+			if (result == 1) {
+				return _map->grid(x, y);
+			}
+			x = y = -1;
+			return (result == 0) ? -1 : -2;
+		}
+		
+		void receive_data(int robot, int kind) {
+			PROFILE_FUNCTION("processing::receive_data");
+			int data[83];
+			while (fifo_data[robot].peek_length() != -1) {
+				int next_kind = fifo_data[robot].peek(0);
+				if (next_kind == 10 && _speed_due[robot] == 0) {
+					break;									//speed data waits for its SPEED status
 				}
-				else {
-					return false;
+				if (next_kind == 11 && ((fifo_data[robot].peek(1) != -1 && _path_due[robot] == 0) ||
+					fifo_data[robot].peek_length() - 3 > _robot_path[robot].free())) {
+					break;									//new path waits for its PATH status
+				}
+				int* message = data;
+				std::vector<int> large;
+				int length = fifo_data[robot].read_n(data, 83);
+				if (length == -2) {							//longer than the server sends, read it whole
+					large.resize(fifo_data[robot].peek_length());
+					message = &large[0];
+					length = fifo_data[robot].read_n(message, large.size());
+				}
+				if (next_kind == 10) {
+					_speed_due[robot]--;
+					if (_fifo_data_index[robot] == -1) {	//start a new run of speed data
+						_fifo_data_index[robot] = 0;
+						_fifo_data_length[robot] = 0;
+					}
+					//append behind any speed data that has not been used yet
+					for (int o = 1; o < length && _fifo_data_length[robot] < 80; o++) {
+						_fifo_data[robot][_fifo_data_length[robot]++] = message[o];
+					}
+				}
+				else if (next_kind == 11) {
+					bool first = (message[1] != -1);
+					if (first) {							//first segment, robot starts on this grid
+						_path_due[robot]--;
+						_main_table[robot].current_grid = message[1];
+						_main_table[robot].current_grid_map_x = _map->grid_x(message[1]);
+						_main_table[robot].current_grid_map_y = _map->grid_y(message[1]);
+						_robot_path[robot].start(_main_table[robot].current_grid_map_x, _main_table[robot].current_grid_map_y);
+					}
+					_robot_path[robot].push(&message[3], length - 3, message[2]);
+					if (first) {							//on its way, even if the status came in before the data
+						int x, y;
+						_main_table[robot].next_grid = path_next_grid(robot, x, y);
+						_main_table[robot].next_grid_map_x = x;
+						_main_table[robot].next_grid_map_y = y;
+						_main_table[robot].status = 0;
+						_main_table[robot].prev_status = 3;
+					}
+				}
+				if (next_kind == kind) {
+					break;
 				}
 			}
 		}
 
-		bool obstacle_move(int obstacle) {
+		template<class behaviour> bool obstacle_move(int obstacle) {
+			PROFILE_FUNCTION("processing::obstacle_move");
 			if (_obstacles[obstacle].status != 2) {		//if obstacle is not CROSSED, we need to move towards the middle, regardles of next grid
 				//MOVE LEFT
 				if (_obstacles[obstacle].next_grid_map_x < _obstacles[obstacle].current_grid_map_x) {
 					//check if obstacle is about to cross grids
 					if (_obstacles[obstacle].position_x - _obstacles[obstacle].speed < 0) {
 						//move the obstacle and update the grid if crossing
-						obstacle_update_grid(obstacle);
+						obstacle_update_grid<behaviour>(obstacle);
 						_obstacles[obstacle].position_x -= _obstacles[obstacle].speed;
 						_obstacles[obstacle].position_x += grid_size;
 						return true;
@@ -611,7 +912,7 @@ template<int map_size_x, int map_size_y, int grid_size, int num_of_robots, int n
 					//check if obstacle is about to cross grids
 					if (_obstacles[obstacle].position_x + _obstacles[obstacle].speed > grid_size) {
 						//move the obstacle and update the grid if crossing
-						obstacle_update_grid(obstacle);
+						obstacle_update_grid<behaviour>(obstacle);
 						_obstacles[obstacle].position_x += _obstacles[obstacle].speed;
 						_obstacles[obstacle].position_x -= grid_size;
 						return true;
@@ -627,7 +928,7 @@ template<int map_size_x, int map_size_y, int grid_size, int num_of_robots, int n
 					//check if obstacle is about to cross grids
 					if (_obstacles[obstacle].position_y - _obstacles[obstacle].speed < 0) {
 						//move the obstacle and update the grid if crossing
-						obstacle_update_grid(obstacle);
+						obstacle_update_grid<behaviour>(obstacle);
 						_obstacles[obstacle].position_y -= _obstacles[obstacle].speed;
 						_obstacles[obstacle].position_y += grid_size;
 						return true;
@@ -643,7 +944,7 @@ template<int map_size_x, int map_size_y, int grid_size, int num_of_robots, int n
 					//check if obstacle is about to cross grids
 					if (_obstacles[obstacle].position_y + _obstacles[obstacle].speed > grid_size) {
 						//move the obstacle and update the grid if crossing
-						obstacle_update_grid(obstacle);
+						obstacle_update_grid<behaviour>(obstacle);
 						_obstacles[obstacle].position_y += _obstacles[obstacle].speed;
 						_obstacles[obstacle].position_y -= grid_size;
 						return true;
@@ -660,17 +961,18 @@ template<int map_size_x, int map_size_y, int grid_size, int num_of_robots, int n
 				}
 			}
 			else {
+				//stop at the middle, speeds of other behaviours need not divide the grid
 				if (_obstacles[obstacle].position_x < grid_size/2) {
-					_obstacles[obstacle].position_x += _obstacles[obstacle].speed;
+					_obstacles[obstacle].position_x += std::min(_obstacles[obstacle].speed, grid_size/2 - _obstacles[obstacle].position_x);
 				}
 				else if (_obstacles[obstacle].position_x > grid_size/2) {
-					_obstacles[obstacle].position_x -= _obstacles[obstacle].speed;
+					_obstacles[obstacle].position_x -= std::min(_obstacles[obstacle].speed, _obstacles[obstacle].position_x - grid_size/2);
 				}
 				else if (_obstacles[obstacle].position_y < grid_size/2) {
-					_obstacles[obstacle].position_y += _obstacles[obstacle].speed;
+					_obstacles[obstacle].position_y += std::min(_obstacles[obstacle].speed, grid_size/2 - _obstacles[obstacle].position_y);
 				}
 				else if (_obstacles[obstacle].position_y > grid_size/2) {
-					_obstacles[obstacle].position_y -= _obstacles[obstacle].speed;
+					_obstacles[obstacle].position_y -= std::min(_obstacles[obstacle].speed, _obstacles[obstacle].position_y - grid_size/2);
 				}
 				if (_obstacles[obstacle].position_x == grid_size/2 &&
 					_obstacles[obstacle].position_y == grid_size/2) {
@@ -682,34 +984,69 @@ template<int map_size_x, int map_size_y, int grid_size, int num_of_robots, int n
 			}
 		}
 		
-		void obstacle_update_grid(int obstacle) {
-			int new_next_grid = -1;
-			//search for next grid in path
-			for (int i = 0; i < 23; i++) {
-				if (_obstacles[obstacle].path[i] == _obstacles[obstacle].next_grid) {
-					new_next_grid = _obstacles[obstacle].path[i+1];
-					break;
-				}
-			}
+		template<class behaviour> void obstacle_update_grid(int obstacle) {
+			int new_next_grid = behaviour::next_grid(_obstacles[obstacle], _map);	//grid after the one being entered
 
+			_obstacles[obstacle].current_grid_map_x = _obstacles[obstacle].next_grid_map_x;
+			_obstacles[obstacle].current_grid_map_y = _obstacles[obstacle].next_grid_map_y;
 			_obstacles[obstacle].current_grid = _obstacles[obstacle].next_grid;
 			_obstacles[obstacle].next_grid = new_next_grid;
-			for (int x = 0; x < map_size_x; x++) {
-				for (int y = 0; y < map_size_y; y++) {
-					//store the map xy coordinate of the grids
-					if (_obstacles[obstacle].current_grid == _map_data[x][y]) {
-						_obstacles[obstacle].current_grid_map_x = x;
-						_obstacles[obstacle].current_grid_map_y = y;
-					}
-					if (_obstacles[obstacle].next_grid == _map_data[x][y]) {
-						_obstacles[obstacle].next_grid_map_x = x;
-						_obstacles[obstacle].next_grid_map_y = y;
-					}
-				}
-			}
+			_obstacles[obstacle].next_grid_map_x = _map->grid_x(new_next_grid);		//store the map xy coordinate of the grid
+			_obstacles[obstacle].next_grid_map_y = _map->grid_y(new_next_grid);
 		}
 
+		void hash_state() {
+			sync_obstacles();
+			for (int i = 0; i < num_of_robots; i++) {
+				int agent = _hash_robot[i];
+				_hash->add(_clock_count, _hash_field[HASH_POSITION_X], agent, _robots[i].position_x);
+				_hash->add(_clock_count, _hash_field[HASH_POSITION_Y], agent, _robots[i].position_y);
+				_hash->add(_clock_count, _hash_field[HASH_SPEED], agent, _robots[i].speed);
+				_hash->add(_clock_count, _hash_field[HASH_STATUS], agent, _main_table[i].status);
+				_hash->add(_clock_count, _hash_field[HASH_PREV_STATUS], agent, _main_table[i].prev_status);
+				_hash->add(_clock_count, _hash_field[HASH_CURRENT_GRID], agent, _main_table[i].current_grid);
+				_hash->add(_clock_count, _hash_field[HASH_NEXT_GRID], agent, _main_table[i].next_grid);
+				_hash->add(_clock_count, _hash_field[HASH_TOKEN_INDEX], agent, _fifo_data_index[i]);
+				_hash->add(_clock_count, _hash_field[HASH_TOKEN_LENGTH], agent, _fifo_data_length[i]);
+				_hash->add(_clock_count, _hash_field[HASH_TX_STATUS], agent, _tx_table[i].status*2 + _tx_table[i].modified);
+			}
+			for (int i = 0; i < num_of_obstacles; i++) {
+				int agent = _hash_obstacle[i];
+				_hash->add(_clock_count, _hash_field[HASH_POSITION_X], agent, _obstacles[i].position_x);
+				_hash->add(_clock_count, _hash_field[HASH_POSITION_Y], agent, _obstacles[i].position_y);
+				_hash->add(_clock_count, _hash_field[HASH_STATUS], agent, _obstacles[i].status);
+				_hash->add(_clock_count, _hash_field[HASH_CURRENT_GRID], agent, _obstacles[i].current_grid);
+				_hash->add(_clock_count, _hash_field[HASH_NEXT_GRID], agent, _obstacles[i].next_grid);
+			}
+		}
+		
+		void publish_telemetry() {
+			PROFILE_FUNCTION("processing::publish_telemetry");
+			sync_obstacles();
+			Telemetry_Robot* robot = (Telemetry_Robot*)_telemetry->begin(TELEMETRY_PROCESSING, _clock_count);
+			for (int i = 0; i < num_of_robots; i++) {
+				robot[i].status = _main_table[i].status;
+				robot[i].current_grid = _main_table[i].current_grid;
+				robot[i].next_grid = _main_table[i].next_grid;
+				robot[i].position_x = _robots[i].position_x;
+				robot[i].position_y = _robots[i].position_y;
+				robot[i].speed = _robots[i].speed;
+			}
+			Telemetry_Obstacle* obstacle = (Telemetry_Obstacle*)(robot + num_of_robots);
+			for (int i = 0; i < num_of_obstacles; i++) {
+				obstacle[i].status = _obstacles[i].status;
+				obstacle[i].current_grid = _obstacles[i].current_grid;
+				obstacle[i].next_grid = _obstacles[i].next_grid;
+				obstacle[i].position_x = _obstacles[i].position_x;
+				obstacle[i].position_y = _obstacles[i].position_y;
+				obstacle[i].reserved = 0;
+			}
+			_telemetry->commit(TELEMETRY_PROCESSING);
+		}
+		
 		void print_stat() {
+			PROFILE_FUNCTION("processing::print_stat");
+			sync_obstacles();
 			for (int i = 0; i < num_of_robots; i++) {
 				cout << "Robot " << i+1 << " Current Grid: " 
 						<< _main_table[i].current_grid
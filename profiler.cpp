@@ -0,0 +1,221 @@
+#ifndef PROFILER_CPP
+#define PROFILER_CPP
+
+//Hot path profiler, off unless built with: make CFLAGS=-DPROFILE
+//	PROFILE_PROCESS(name)	time of one SC_METHOD activation, first line of the method
+//	PROFILE_FUNCTION(name)	time of one call, first line of the function (inclusive of callees)
+//	PROFILE_THREAD(name)	first line of an SC_THREAD, its waits are written PROFILE_WAIT(wait(...))
+//	PROFILE_DELTA()			once per clock, counts the delta cycles since the last clock
+//	PROFILE_RUN(call)		wraps sc_start, everything not inside a process is kernel time
+//	PROFILE_REPORT(file)	prints the table sorted by time and writes it to file as JSON
+//Without PROFILE all of these expand to nothing (PROFILE_WAIT and PROFILE_RUN to their call).
+//Functions may be profiled from the parallel step's worker threads, so counters are atomic.
+#ifdef PROFILE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "systemc.h"
+
+#define PROFILE_DELTA_BINS 16		//delta cycles per clock histogram, the last bin is open ended
+
+static inline uint64_t profile_ns() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec*1000000000ull + now.tv_nsec;
+}
+
+static inline uint64_t profile_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return profile_ns();
+#endif
+}
+
+typedef struct Profile_Counter {
+	const char* name;
+	bool process;			//SystemC process, not a function called from one
+	uint64_t calls;			//activations or calls
+	uint64_t ticks;
+}Profile_Counter;
+
+class profile_registry {
+	public:
+		static profile_registry& get() {
+			static profile_registry registry;
+			return registry;
+		}
+
+		//same name from several call sites or template instances shares one counter
+		Profile_Counter* add(const char* name, bool process) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (int i = 0; i < (int)_counters.size(); i++) {
+				if (strcmp(_counters[i]->name, name) == 0) {
+					return _counters[i];
+				}
+			}
+			Profile_Counter* counter = new Profile_Counter();
+			counter->name = name;
+			counter->process = process;
+			_counters.push_back(counter);
+			return counter;
+		}
+
+		void delta() {
+			uint64_t count = sc_delta_count();
+			uint64_t deltas = count - _last_delta;
+			_last_delta = count;
+			_clocks++;
+			_deltas += deltas;
+			_max_deltas = std::max(_max_deltas, deltas);
+			_delta_bins[std::min<uint64_t>(deltas, PROFILE_DELTA_BINS - 1)]++;
+		}
+
+		void run_begin() {
+			_run_ns = profile_ns();
+			_run_ticks = profile_ticks();
+		}
+
+		void run_end() {
+			_run_ns = profile_ns() - _run_ns;
+			_run_ticks = profile_ticks() - _run_ticks;
+		}
+
+		void report(const char* json_file) {
+			double ns_per_tick = _run_ticks ? (double)_run_ns/_run_ticks : 1.0;
+			std::vector<Profile_Counter*> sorted(_counters);
+			std::sort(sorted.begin(), sorted.end(), by_ticks);
+			uint64_t process_ticks = 0;
+			for (int i = 0; i < (int)sorted.size(); i++) {
+				if (sorted[i]->process) {
+					process_ticks += sorted[i]->ticks;
+				}
+			}
+			uint64_t kernel_ticks = (_run_ticks > process_ticks) ? _run_ticks - process_ticks : 0;
+
+			printf("\nPROFILE: run %.3f ms, %.3f GHz timestamp counter, function times include callees\n",
+				   _run_ns/1e6, ns_per_tick > 0 ? 1.0/ns_per_tick : 0.0);
+			printf("%-32s %-9s %12s %12s %10s %7s\n", "name", "kind", "calls", "total ms", "mean us", "% run");
+			for (int i = 0; i < (int)sorted.size(); i++) {
+				print_row(sorted[i]->name, sorted[i]->process ? "process" : "function", sorted[i]->calls, sorted[i]->ticks, ns_per_tick);
+			}
+			print_row("(kernel and unprofiled)", "kernel", 0, kernel_ticks, ns_per_tick);
+			printf("delta cycles: %llu over %llu clocks, mean %.2f, max %llu per clock\n",
+				   (unsigned long long)_deltas, (unsigned long long)_clocks,
+				   _clocks ? (double)_deltas/_clocks : 0.0, (unsigned long long)_max_deltas);
+
+			FILE* file = fopen(json_file, "w");
+			if (file == NULL) {
+				printf("Error: could not write %s\n", json_file);
+				return;
+			}
+			fprintf(file, "{\n  \"run_ns\": %llu,\n  \"ns_per_tick\": %.6f,\n  \"kernel_ns\": %.0f,\n  \"counters\": [\n",
+					(unsigned long long)_run_ns, ns_per_tick, kernel_ticks*ns_per_tick);
+			for (int i = 0; i < (int)sorted.size(); i++) {
+				fprintf(file, "    {\"name\": \"%s\", \"kind\": \"%s\", \"calls\": %llu, \"ns\": %.0f}%s\n",
+						sorted[i]->name, sorted[i]->process ? "process" : "function",
+						(unsigned long long)sorted[i]->calls, sorted[i]->ticks*ns_per_tick,
+						(i + 1 < (int)sorted.size()) ? "," : "");
+			}
+			fprintf(file, "  ],\n  \"deltas\": {\"clocks\": %llu, \"total\": %llu, \"max\": %llu, \"per_clock\": [",
+					(unsigned long long)_clocks, (unsigned long long)_deltas, (unsigned long long)_max_deltas);
+			for (int i = 0; i < PROFILE_DELTA_BINS; i++) {
+				fprintf(file, "%llu%s", (unsigned long long)_delta_bins[i], (i + 1 < PROFILE_DELTA_BINS) ? ", " : "");
+			}
+			fprintf(file, "]}\n}\n");
+			fclose(file);
+		}
+
+	private:
+		std::vector<Profile_Counter*> _counters;
+		std::mutex _mutex;
+		uint64_t _run_ns;
+		uint64_t _run_ticks;
+		uint64_t _last_delta;
+		uint64_t _clocks;
+		uint64_t _deltas;
+		uint64_t _max_deltas;
+		uint64_t _delta_bins[PROFILE_DELTA_BINS];	//clocks by the number of delta cycles they took
+
+		profile_registry():_run_ns(0), _run_ticks(0), _last_delta(0), _clocks(0), _deltas(0), _max_deltas(0) {
+			memset(_delta_bins, 0, sizeof(_delta_bins));
+		}
+
+		static bool by_ticks(const Profile_Counter* a, const Profile_Counter* b) {
+			return a->ticks > b->ticks;
+		}
+
+		void print_row(const char* name, const char* kind, uint64_t calls, uint64_t ticks, double ns_per_tick) {
+			printf("%-32s %-9s %12llu %12.3f %10.3f %6.1f%%\n", name, kind, (unsigned long long)calls,
+				   ticks*ns_per_tick/1e6, calls ? ticks*ns_per_tick/calls/1e3 : 0.0,
+				   _run_ticks ? 100.0*ticks/_run_ticks : 0.0);
+		}
+};
+
+class profile_scope {
+	public:
+		profile_scope(Profile_Counter* counter):_counter(counter), _start(profile_ticks()) {}
+		~profile_scope() {
+			__atomic_fetch_add(&_counter->calls, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&_counter->ticks, profile_ticks() - _start, __ATOMIC_RELAXED);
+		}
+
+	private:
+		Profile_Counter* _counter;
+		uint64_t _start;
+};
+
+class profile_thread {			//times a thread between its waits
+	public:
+		profile_thread(Profile_Counter* counter):_counter(counter) {
+			resume();
+		}
+		void suspend() {
+			_counter->ticks += profile_ticks() - _start;
+		}
+		void resume() {
+			_counter->calls++;
+			_start = profile_ticks();
+		}
+
+	private:
+		Profile_Counter* _counter;
+		uint64_t _start;
+};
+
+#define PROFILE_CAT2(a, b) a##b
+#define PROFILE_CAT(a, b) PROFILE_CAT2(a, b)
+#define PROFILE_SCOPE(name, process) \
+	static Profile_Counter* PROFILE_CAT(_profile_counter_, __LINE__) = profile_registry::get().add(name, process); \
+	profile_scope PROFILE_CAT(_profile_scope_, __LINE__)(PROFILE_CAT(_profile_counter_, __LINE__))
+#define PROFILE_PROCESS(name) PROFILE_SCOPE(name, true)
+#define PROFILE_FUNCTION(name) PROFILE_SCOPE(name, false)
+#define PROFILE_THREAD(name) \
+	static Profile_Counter* _profile_thread_counter = profile_registry::get().add(name, true); \
+	profile_thread _profile_thread(_profile_thread_counter)
+#define PROFILE_WAIT(call) do { _profile_thread.suspend(); call; _profile_thread.resume(); } while (0)
+#define PROFILE_DELTA() profile_registry::get().delta()
+#define PROFILE_RUN(call) do { profile_registry::get().run_begin(); call; profile_registry::get().run_end(); } while (0)
+#define PROFILE_REPORT(file) profile_registry::get().report(file)
+
+#else
+
+#define PROFILE_PROCESS(name)
+#define PROFILE_FUNCTION(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_WAIT(call) call
+#define PROFILE_DELTA()
+#define PROFILE_RUN(call) call
+#define PROFILE_REPORT(file)
+
+#endif
+
+#endif
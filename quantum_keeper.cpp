@@ -0,0 +1,54 @@
+#ifndef QUANTUM_KEEPER_CPP
+#define QUANTUM_KEEPER_CPP
+
+#include <math.h>
+#include "systemc.h"
+
+//Local time of a loosely timed process, after tlm_utils::tlm_quantumkeeper.
+//The process adds the time its work takes with inc() and keeps running ahead of
+//the kernel until need_sync(), then hands the time back with sync(). Syncs are
+//due at multiples of the global quantum, so processes sharing a quantum meet at
+//the same points in simulated time. A zero quantum means no decoupling.
+class quantum_keeper {
+	public:
+		//CONSTRUCTOR
+		quantum_keeper() {
+			reset();
+		}
+
+		static void set_global_quantum(const sc_time& quantum) { global_quantum() = quantum; }
+		static const sc_time& get_global_quantum() { return global_quantum(); }
+
+		void inc(const sc_time& t) { _local += t; }
+		sc_time get_local_time() const { return _local; }
+		sc_time get_current_time() const { return sc_time_stamp() + _local; }
+		sc_time get_next_sync_time() const { return _next_sync; }
+		bool need_sync() const { return get_current_time() >= _next_sync; }
+
+		void sync() {							//from a thread
+			wait(_local);
+			reset();
+		}
+
+		void reset() {
+			_local = SC_ZERO_TIME;
+			const sc_time& quantum = global_quantum();
+			if (quantum == SC_ZERO_TIME) {
+				_next_sync = sc_time_stamp();
+			}
+			else {
+				_next_sync = quantum*(floor(sc_time_stamp()/quantum) + 1);
+			}
+		}
+
+	private:
+		sc_time _local;							//ahead of sc_time_stamp()
+		sc_time _next_sync;
+
+		static sc_time& global_quantum() {
+			static sc_time quantum = SC_ZERO_TIME;
+			return quantum;
+		}
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef REALTIME_PACER_CPP
+#define REALTIME_PACER_CPP
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include "systemc.h"
+
+//Holds every clock tick back until its time on the monotonic wall clock, for
+//running the server against outside hardware or a stand-in robot process:
+//	-realtime 1		one simulated second per second
+//	-realtime 4		four times faster, 0.5 half as fast
+//The pacer wakes first at each tick, before the clock edge reaches any module,
+//so when it runs all work of the previous tick is done. What is left until the
+//tick's deadline is that tick's slack; with none left the deadline was missed.
+//Deadlines stay on the schedule set at the start, so a late tick does not push
+//back the ones after it and the run catches up when it can. Jitter is how late
+//a tick starts after its deadline, from the OS waking the pacer late or from an
+//overrun. Written to a JSON file with percentiles at the end of the run.
+class realtime_pacer:public sc_module {
+	public:
+		//CONSTRUCTOR
+		SC_HAS_PROCESS(realtime_pacer);
+
+		realtime_pacer(sc_module_name name, const sc_time& tick, double factor):sc_module(name), _tick(tick), _factor(factor) {
+			SC_THREAD(prc_pace);
+		}
+
+		bool write(const char* file) const {
+			FILE* out = fopen(file, "w");
+			if (out == NULL) {
+				return false;
+			}
+			std::vector<int64_t> slack, jitter, work;
+			for (int i = 0; i < (int)_ticks.size(); i++) {
+				slack.push_back(_ticks[i].slack);
+				jitter.push_back(_ticks[i].jitter);
+				work.push_back(_ticks[i].work);
+			}
+			std::sort(slack.begin(), slack.end());
+			std::sort(jitter.begin(), jitter.end());
+			std::sort(work.begin(), work.end());
+			double budget = (_tick/sc_time(1, SC_NS))/_factor;
+			fprintf(out, "{\n  \"factor\": %g,\n  \"tick_us\": %.1f,\n  \"ticks\": %d,\n  \"misses\": %d,\n  \"longest_miss_run\": %d,\n",
+					_factor, budget/1000, (int)_ticks.size(), misses(), longest_miss_run());
+			fprintf(out, "  \"slack_us\": {\"min\": %.1f, \"p1\": %.1f, \"p5\": %.1f, \"p50\": %.1f},\n",
+					percentile(slack, 0)/1000, percentile(slack, 1)/1000, percentile(slack, 5)/1000, percentile(slack, 50)/1000);
+			fprintf(out, "  \"load\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",	//work of a tick over its time on the wall clock
+					percentile(work, 50)/budget, percentile(work, 99)/budget, percentile(work, 100)/budget);
+			fprintf(out, "  \"jitter_us\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p99.9\": %.1f, \"max\": %.1f}\n}\n",
+					percentile(jitter, 50)/1000, percentile(jitter, 90)/1000, percentile(jitter, 99)/1000,
+					percentile(jitter, 99.9)/1000, percentile(jitter, 100)/1000);
+			return fclose(out) == 0;
+		}
+
+		int ticks() const { return _ticks.size(); }
+
+		int misses() const {
+			int count = 0;
+			for (int i = 0; i < (int)_ticks.size(); i++) {
+				count += _ticks[i].slack < 0;
+			}
+			return count;
+		}
+
+	private:
+		//LOCAL VAR
+		typedef struct Tick {
+			int64_t slack;			//ns left before the deadline when the work was done, negative if missed
+			int64_t jitter;			//ns the tick started after its deadline
+			int64_t work;			//ns from the tick's start until all its work was done
+		}Tick;
+
+		sc_time _tick;
+		double _factor;				//simulated time per wall clock time
+		int64_t _start;				//wall clock at simulated time 0, ns
+		std::vector<Tick> _ticks;
+
+		//PROCESS
+		void prc_pace() {
+			_start = pace_ns();
+			int64_t started = _start;				//when the previous tick got going
+			while (1) {
+				wait(_tick);						//woken before this tick's clock edge is seen
+				int64_t deadline = _start + (int64_t)((sc_time_stamp()/sc_time(1, SC_NS))/_factor);
+				int64_t done = pace_ns();
+				Tick tick;
+				tick.slack = deadline - done;
+				tick.work = done - started;
+				if (tick.slack > 0) {
+					timespec until;
+					until.tv_sec = deadline/1000000000;
+					until.tv_nsec = deadline%1000000000;
+					while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+					}
+				}
+				started = pace_ns();
+				tick.jitter = std::max<int64_t>(started - deadline, 0);
+				_ticks.push_back(tick);
+			}
+		}
+
+		static int64_t pace_ns() {
+			timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			return (int64_t)now.tv_sec*1000000000 + now.tv_nsec;
+		}
+
+		static double percentile(const std::vector<int64_t>& sorted, double p) {	//nearest rank
+			if (sorted.empty()) {
+				return 0;
+			}
+			int rank = (int)(p/100*sorted.size() + 0.999999);
+			return sorted[std::min(std::max(rank - 1, 0), (int)sorted.size() - 1)];
+		}
+
+		int longest_miss_run() const {
+			int longest = 0;
+			for (int i = 0, run = 0; i < (int)_ticks.size(); i++) {
+				run = (_ticks[i].slack < 0) ? run + 1 : 0;
+				longest = std::max(longest, run);
+			}
+			return longest;
+		}
+};
+
+#endif
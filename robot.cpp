@@ -1,10 +1,9 @@
 #include <systemc.h>
-
-static const char* status_names[] =
-	{
-		"STOPPED1", "RESTART", "CROSSING", "STOPPED2", "CROSSED",
-		"OK1", "OK2", "STOP1", "STOP2", "RESUME", "SPEED", "PATH"
-	};
+#include "profiler.cpp"
+#include "quantum_keeper.cpp"
+#include "link_health.cpp"
+#include "frame.cpp"
+#include "latency_trace.cpp"
 
 class robot:public sc_module {
 	public:
@@ -13,33 +12,41 @@ class robot:public sc_module {
 		
 		sc_in<bool> tx_ack_s;
 		sc_out<bool> tx_flag_s;
-		sc_out<sc_uint<16> > tx_data_s;
+		sc_out<frame_word> tx_data_s;
 		sc_out<bool> rx_ack_s;
 		sc_in<bool> rx_flag_s;
-		sc_in<sc_uint<16> > rx_data_s;
+		sc_in<frame_word> rx_data_s;
 		
 		sc_in<bool> tx_ack_p;
 		sc_out<bool> tx_flag_p;
-		sc_out<sc_uint<16> > tx_data_p;
+		sc_out<frame_word> tx_data_p;
 		sc_out<bool> rx_ack_p;
 		sc_in<bool> rx_flag_p;
-		sc_in<sc_uint<16> > rx_data_p;
+		sc_in<frame_word> rx_data_p;
 		
 		//CONSTRUCTOR
 		SC_HAS_PROCESS(robot);
 		
-		robot(sc_module_name name):sc_module(name) {
-			SC_METHOD(prc_update);
-			sensitive << clock.pos() << rx_flag_s << rx_flag_p;
+		robot(sc_module_name name, int index = 0, latency_trace* trace = 0):
+		sc_module(name), _health((const char*)name, LINKS), _index(index), _trace(trace) {
+			if (quantum_keeper::get_global_quantum() == SC_ZERO_TIME) {
+				SC_METHOD(prc_update);
+				sensitive << rx_flag_s << rx_flag_p;
+				
+				SC_METHOD(prc_poll);
+				sensitive << poll_signal;
+				dont_initialize();
+			}
+			else {											//loosely timed, see prc_relay
+				SC_THREAD(prc_relay);
+			}
 			
 			SC_THREAD(prc_tx_s);
-			sensitive << tx_ack_s.pos();
 			
 			SC_THREAD(prc_rx_s);
 			sensitive << rx_flag_s.pos();
 			
 			SC_THREAD(prc_tx_p);
-			sensitive << tx_ack_p.pos();
 			
 			SC_THREAD(prc_rx_p);
 			sensitive << rx_flag_p.pos();
@@ -48,6 +55,9 @@ class robot:public sc_module {
 			_rx_table_s.modified = 0;
 			_tx_table_p.modified = 0;
 			_rx_table_p.modified = 0;
+			_polling = false;
+			_health.name_link(LINK_SERVER, "server");
+			_health.name_link(LINK_PROCESSING, "processing");
 		}
 
 	private:
@@ -61,78 +71,205 @@ class robot:public sc_module {
 		Robot_Status _rx_table_s;
 		Robot_Status _tx_table_p;
 		Robot_Status _rx_table_p;
+		frame_queue _tx_queue_s;			//statuses for the next frame to the server
+		frame_queue _rx_queue_s;			//statuses from the server not relayed yet
+		frame_queue _tx_queue_p;
+		frame_queue _rx_queue_p;
 		
 		sc_event tx_signal_s;
 		sc_event tx_signal_p;
+		sc_event poll_signal;				//a word is waiting for its tx channel, wakes prc_poll
+		bool _polling;						//prc_poll runs on clock edges
+		quantum_keeper _keeper;
+		link_health _health;				//handshake retries to the server and processing
+		enum {LINK_SERVER, LINK_PROCESSING, LINKS};
+		int _index;							//robot number from 0, for the trace
+		latency_trace* _trace;				//status latencies, 0 if disabled
 		
 		//PROCESS
 		void prc_rx_s() {
+			PROFILE_THREAD("robot::prc_rx_s");
 			while(1) {
-				wait();
+				PROFILE_WAIT(wait());
 				rx_ack_s = 1;								//send ack bit
-				_rx_table_s.status = rx_data_s.read();		//update rx table
-				_rx_table_s.modified = 1;
-				cout << "Time " << sc_time_stamp() << " | "
-					 <<	name() << " recieved from server: " << status_names[rx_data_s.read()] << endl;
-				wait(SC_ZERO_TIME);
+				int first = _rx_queue_s.size();
+				if (_rx_queue_s.receive(rx_data_s.read()) > 0) {	//new statuses, not a repeat
+					_rx_table_s.status = _rx_queue_s.status(_rx_queue_s.size() - 1);	//update rx table
+					_rx_table_s.modified = 1;
+				}
+				for (int k = first; k < _rx_queue_s.size(); k++) {
+					if (_trace) {
+						_trace->stamp(_index, _rx_queue_s.tag(k), _rx_queue_s.status(k), TRACE_ROBOT_IN);
+					}
+					cout << "Time " << sc_time_stamp() << " | "
+						 <<	name() << " recieved from server: " << status_names[_rx_queue_s.status(k)] << endl;
+				}
+				PROFILE_WAIT(wait(SC_ZERO_TIME));
 				rx_ack_s = 0;
 			}
 		}
 		
 		void prc_rx_p() {
+			PROFILE_THREAD("robot::prc_rx_p");
 			while(1) {
-				wait();
+				PROFILE_WAIT(wait());
 				rx_ack_p = 1;								//send ack bit
-				_rx_table_p.status = rx_data_p.read();		//update rx table
-				_rx_table_p.modified = 1;
-				cout << "Time " << sc_time_stamp() << " | "
-					 <<	name() << " recieved from processing: " << status_names[rx_data_p.read()] << endl;
-				wait(SC_ZERO_TIME);
+				int first = _rx_queue_p.size();
+				if (_rx_queue_p.receive(rx_data_p.read()) > 0) {	//new statuses, not a repeat
+					_rx_table_p.status = _rx_queue_p.status(_rx_queue_p.size() - 1);	//update rx table
+					_rx_table_p.modified = 1;
+				}
+				for (int k = first; k < _rx_queue_p.size(); k++) {
+					if (_trace) {
+						_trace->stamp(_index, _rx_queue_p.tag(k), _rx_queue_p.status(k), TRACE_ROBOT_IN);
+					}
+					cout << "Time " << sc_time_stamp() << " | "
+						 <<	name() << " recieved from processing: " << status_names[_rx_queue_p.status(k)] << endl;
+				}
+				PROFILE_WAIT(wait(SC_ZERO_TIME));
 				rx_ack_p = 0;
 			}
 		}
 		
 		void prc_tx_s() {
+			PROFILE_THREAD("robot::prc_tx_s");
 			while(1) {
-				wait(tx_signal_s);
-				tx_flag_s = 1;						//set tx flag
-				tx_data_s = _tx_table_s.status;		//write data to tx channel
-				_tx_table_s.modified = 0;
-				wait();								//wait for ack bit from server
-				if (tx_ack_s != 1) {				//if not acknowledge from the server
+				PROFILE_WAIT(wait(tx_signal_s));
+				int sent = 0;							//statuses in the frame
+				for (int tries = 0; tries == 0 || (tx_ack_s != 1 && _health.timed_out(LINK_SERVER)); tries++) {
+					if (tries > 0) {
+						tx_flag_s = 0;				//back off, then send the frame again
+						PROFILE_WAIT(wait(_health.retry_at(LINK_SERVER) - sc_time_stamp()));
+					}
+					sent = _tx_queue_s.framed();
+					tx_flag_s = 1;						//set tx flag
+					tx_data_s = _tx_queue_s.word();		//write frame to tx channel
+					_tx_table_s.modified = 0;
+					stamp_sent(_tx_queue_s, sent);
+					_health.sent(LINK_SERVER);
+					PROFILE_WAIT(wait(_health.timeout(), tx_ack_s.posedge_event()));	//wait for ack bit from server
+				}
+				tx_flag_s = 0;						//clear tx flag
+				if (tx_ack_s == 1) {
+					_health.acked(LINK_SERVER);
+					for (int k = 0; k < sent; k++) {
+						cout << "Time " << sc_time_stamp() << " | "
+							 <<	name() << " sent to server: " << status_names[_tx_queue_s.status(k)] << endl;
+					}
+					_tx_queue_s.acked(sent);
+					if (!_tx_queue_s.empty()) {
+						_tx_table_s.modified = 1;		//more than one frame was queued
+						poll_signal.notify(SC_ZERO_TIME);
+					}
+				}
+				else {								//no ack from the server, the link is dead
 					_tx_table_p.status = 7;			//send STOP1 signal to processing
 					_tx_table_p.modified = 1;
+					_tx_queue_p.push(7, FRAME_NONE, FRAME_NONE, _trace ? _trace->open(_index, TRACE_ROBOT, 7) : 0);
 					_tx_table_s.status = 3;			//send STOPPED2 signal to server
 					_tx_table_s.modified = 0;
+					_tx_queue_s.clear();
+					poll_signal.notify(SC_ZERO_TIME);
+					cout << "Time " << sc_time_stamp() << " | "
+						 <<	name() << " sent to server: " << status_names[_tx_table_s.status] << endl;
 				}
-				tx_flag_s = 0;						//clear tx flag
-				cout << "Time " << sc_time_stamp() << " | "
-					 <<	name() << " sent to server: " << status_names[_tx_table_s.status] << endl;
-				wait(SC_ZERO_TIME);
+				PROFILE_WAIT(wait(SC_ZERO_TIME));
 			}
 		}
 		
 		void prc_tx_p() {
+			PROFILE_THREAD("robot::prc_tx_p");
 			while(1) {
-				wait(tx_signal_p);
-				tx_flag_p = 1;						//set tx flag
-				tx_data_p = _tx_table_p.status;		//write data to tx channel
-				_tx_table_p.modified = 0;
-				wait();								//wait for ack bit from processing
+				PROFILE_WAIT(wait(tx_signal_p));
+				int sent = 0;							//statuses in the frame
+				for (int tries = 0; tries == 0 || (tx_ack_p != 1 && _health.timed_out(LINK_PROCESSING)); tries++) {
+					if (tries > 0) {
+						tx_flag_p = 0;				//back off, then send the frame again
+						PROFILE_WAIT(wait(_health.retry_at(LINK_PROCESSING) - sc_time_stamp()));
+					}
+					sent = _tx_queue_p.framed();
+					tx_flag_p = 1;						//set tx flag
+					tx_data_p = _tx_queue_p.word();		//write frame to tx channel
+					_tx_table_p.modified = 0;
+					stamp_sent(_tx_queue_p, sent);
+					_health.sent(LINK_PROCESSING);
+					PROFILE_WAIT(wait(_health.timeout(), tx_ack_p.posedge_event()));	//wait for ack bit from processing
+				}
 				tx_flag_p = 0;						//clear tx flag
-				cout << "Time " << sc_time_stamp() << " | "
-					 <<	name() << " sent to processing: " << status_names[_tx_table_p.status] << endl;
-				wait(SC_ZERO_TIME);
+				for (int k = 0; k < sent; k++) {
+					cout << "Time " << sc_time_stamp() << " | " << name()
+						 << (tx_ack_p == 1 ? " sent to processing: " : " gave up sending to processing: ")	//no ack, the link is dead
+						 << status_names[_tx_queue_p.status(k)] << endl;
+				}
+				if (tx_ack_p == 1) {
+					_health.acked(LINK_PROCESSING);
+				}
+				_tx_queue_p.acked(sent);
+				if (!_tx_queue_p.empty()) {
+					_tx_table_p.modified = 1;			//more than one frame was queued
+					poll_signal.notify(SC_ZERO_TIME);
+				}
+				PROFILE_WAIT(wait(SC_ZERO_TIME));
 			}
 		}
 		
 		void prc_update() {
+			PROFILE_PROCESS("robot::prc_update");
+			relay();
+		}
+		
+		//Clock edges are only needed while a word waits for a busy tx channel. The
+		//robot is idle otherwise and only wakes on its rx flags.
+		void prc_poll() {
+			PROFILE_PROCESS("robot::prc_poll");
+			if (_polling) {								//woken by the clock edge
+				relay();
+			}
+			_polling = _tx_table_s.modified || _tx_table_p.modified;
+			if (_polling) {
+				next_trigger(clock.posedge_event());
+			}
+		}
+
+		//Loosely timed relay. Instead of checking the tables on every clock edge and
+		//flag change, the robot runs ahead to the next quantum boundary and only
+		//syncs there. Words received in between are relayed at the boundary, so each
+		//hop through the robot is up to a quantum late. Measured on the default
+		//scenario with -latency: a quantum of 10 ms (one clock) adds 10 ms per hop,
+		//20 ms adds 13 ms on average and the fleet still finishes; from 50 ms on
+		//(40 ms per hop) a robot no longer reaches its goal in SIM_TIME.
+		void prc_relay() {
+			PROFILE_THREAD("robot::prc_relay");
+			_keeper.reset();
+			while(1) {
+				relay();
+				_keeper.inc(_keeper.get_next_sync_time() - _keeper.get_current_time());
+				PROFILE_WAIT(_keeper.sync());
+			}
+		}
+
+		void forward(frame_queue& from, frame_queue& to) {	//received statuses, with their grid and speed
+			for (int k = 0; k < from.size(); k++) {
+				to.push(from.status(k), from.grid(), from.speed(), from.tag(k));
+			}
+			from.clear();
+		}
+		
+		void stamp_sent(const frame_queue& queue, int sent) {
+			for (int k = 0; _trace && k < sent; k++) {
+				_trace->stamp(_index, queue.tag(k), queue.status(k), TRACE_ROBOT_OUT);
+			}
+		}
+		
+		void relay() {
 			if (_rx_table_s.modified) {
+				forward(_rx_queue_s, _tx_queue_p);
 				_tx_table_p.status = _rx_table_s.status;
 				_tx_table_p.modified = 1;
 				_rx_table_s.modified = 0;
 			}
 			if (_rx_table_p.modified) {
+				forward(_rx_queue_p, _tx_queue_s);
 				_tx_table_s.status = _rx_table_p.status;
 				_tx_table_s.modified = 1;
 				_rx_table_p.modified = 0;
@@ -144,5 +281,8 @@ class robot:public sc_module {
 			if (_tx_table_p.modified) {
 				tx_signal_p.notify(SC_ZERO_TIME);
 			}
+			if (_tx_table_s.modified || _tx_table_p.modified) {
+				poll_signal.notify(SC_ZERO_TIME);
+			}
 		}
 };
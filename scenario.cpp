@@ -0,0 +1,312 @@
+#ifndef SCENARIO_CPP
+#define SCENARIO_CPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "map_file.cpp"
+#include "junction_graph.cpp"
+#include "seeded_random.cpp"
+
+#define SCENARIO_CROSS_AISLE 6		//columns between two cross-aisles
+#define SCENARIO_OPENING 8			//percent of other rack cells left open as a gap
+#define SCENARIO_LOOP_SPAN 3		//an obstacle loop runs around at most this many rack rows/cross-aisle gaps
+#define SCENARIO_CLOCKS_PER_GRID 200	//simulated clocks given per grid of the longest route
+#define SCENARIO_RELEASE_FIRST 101	//clock count at which the first robot gets its path
+#define SCENARIO_RELEASE_GAP 100		//clocks between two robots getting their paths
+
+typedef struct Scenario_Params {
+	uint64_t seed;
+	int size_x;
+	int size_y;
+	int robots;
+	int obstacles;
+	int cross_aisle;			//columns between two cross-aisles
+	int opening;				//percent of rack cells that are gaps
+}Scenario_Params;
+
+//Seeded warehouse layout in the form main.cpp uses. Even rows are aisles, odd
+//rows are racks (-1) except at the outer columns, every cross_aisle columns and
+//at random gaps. Grid numbers run row-major over the walkable cells from 1, like
+//the hand-drawn map. Aisles, cross-aisles and gaps are one-way and alternate in
+//direction, as in a real pick floor, so generated robots never meet head-on in a
+//corridor, which the server only resolves at intersections. Robot routes are
+//shortest one-way paths between distinct start and goal grids, -1 terminated,
+//planned on the junction graph of the floor.
+//Robots get their paths one after another, SCENARIO_RELEASE_GAP clocks apart.
+//Obstacle paths are loops around blocks of racks that follow the one-way
+//directions and start and end on the same grid, so the grid after any grid of
+//the loop is the one following its first occurrence. The same seed and
+//parameters always give the same scenario.
+class scenario {
+	public:
+		scenario():_state(0) {}
+
+		bool generate(const Scenario_Params& params) {
+			_params = params;
+			_state = params.seed;
+			build_map();
+			return build_robots() && build_obstacles();
+		}
+
+		const int* map() const { return &_map[0]; }		//row-major, for map_file_write()
+
+		//map interface for junction_graph, all steps between walkable neighbours
+		int num_grids() const { return _grid_cell.size() - 1; }
+		int grid_x(int grid) const { return (grid < 1 || grid >= (int)_grid_cell.size()) ? -1 : _grid_cell[grid] % _params.size_x; }
+
+		int neighbour(int grid, int direction) const {		//PATH_RIGHT/LEFT/UP/DOWN
+			static const int moves[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+			int x = _grid_cell[grid] % _params.size_x + moves[direction][0];
+			int y = _grid_cell[grid] / _params.size_x + moves[direction][1];
+			if (x < 0 || y < 0 || x >= _params.size_x || y >= _params.size_y) {
+				return -1;
+			}
+			return cell(x, y);
+		}
+
+		int path_length() const {					//row length of both path tables, with room for the -1
+			size_t length = 0;
+			for (size_t i = 0; i < _robot_path.size(); i++) {
+				length = std::max(length, _robot_path[i].size());
+			}
+			for (size_t i = 0; i < _obstacle_path.size(); i++) {
+				length = std::max(length, _obstacle_path[i].size() + 1);
+			}
+			return length;
+		}
+
+		int sim_time() const {						//ms, a multiple of 20 ms (two clocks per stimulus step)
+			int last = 0;							//clock by which the last robot should be done
+			for (size_t i = 0; i < _robot_path.size(); i++) {
+				last = std::max(last, _path_release[i] + (int)_robot_path[i].size()*SCENARIO_CLOCKS_PER_GRID);
+			}
+			return (last/2 + 100)*20;
+		}
+
+		//header for main.cpp: make CFLAGS='-DSCENARIO="\"<file>\""'
+		bool write_header(const char* file_name) const {
+			FILE* out = fopen(file_name, "w");
+			if (out == NULL) {
+				return false;
+			}
+			int length = path_length();
+			fprintf(out, "//Generated warehouse scenario, seed %llu: %dx%d map, %d robots, %d obstacles\n",
+					(unsigned long long)_params.seed, _params.size_x, _params.size_y, _params.robots, _params.obstacles);
+			fprintf(out, "#define MAP_SIZE_X %d\n#define MAP_SIZE_Y %d\n", _params.size_x, _params.size_y);
+			fprintf(out, "#define NUM_OF_ROBOTS %d\n#define NUM_OF_OBSTACLES %d\n", _params.robots, _params.obstacles);
+			fprintf(out, "#define PATH_LENGTH %d\n#define NUM_NODE_ORDERS 1\n#define SIM_TIME %d\n\n", length, sim_time());
+			fprintf(out, "static constexpr int scenario_map[MAP_SIZE_Y][MAP_SIZE_X] =\n{\n");
+			for (int y = 0; y < _params.size_y; y++) {
+				write_row(out, &_map[y*_params.size_x], _params.size_x, _params.size_x);
+			}
+			fprintf(out, "};\n\nstatic constexpr int scenario_robot_path[NUM_OF_ROBOTS][PATH_LENGTH] =\n{\n");
+			for (int i = 0; i < _params.robots; i++) {
+				write_row(out, &_robot_path[i][0], _robot_path[i].size(), length);
+			}
+			fprintf(out, "};\n\nstatic constexpr int scenario_path_release[NUM_OF_ROBOTS] =\n{\n\t");
+			for (int i = 0; i < _params.robots; i++) {
+				fprintf(out, "%s%d", i ? "," : "", _path_release[i]);
+			}
+			fprintf(out, "\n");
+			fprintf(out, "};\n\nstatic constexpr int scenario_node_order[NUM_NODE_ORDERS][NUM_OF_ROBOTS + 1] =\n{\n");
+			fprintf(out, "\t{\t-1\t}\t\t//no fixed orders, robots cross in expected arrival order\n");
+			fprintf(out, "};\n\nstatic constexpr int scenario_obstacle_path[NUM_OF_OBSTACLES][PATH_LENGTH] =\n{\n");
+			for (int i = 0; i < _params.obstacles; i++) {
+				write_row(out, &_obstacle_path[i][0], _obstacle_path[i].size(), length);
+			}
+			fprintf(out, "};\n");
+			return fclose(out) == 0;
+		}
+
+	private:
+		Scenario_Params _params;
+		uint64_t _state;
+		std::vector<int> _map;						//row-major, -1 for racks
+		std::vector<int> _grid_cell;				//cell of every grid number (index 0 unused)
+		std::vector<int> _open_columns;				//walkable on every row
+		std::vector<int> _aisle_rows;
+		std::vector<int> _row_direction;			//+1/-1 along x on aisle rows, 0 elsewhere
+		std::vector<int> _column_direction;			//+1/-1 along y on open columns and gaps, 0 elsewhere
+		std::vector<std::vector<int> > _robot_path;
+		std::vector<int> _path_release;				//clock count at which each robot gets its path
+		std::vector<std::vector<int> > _obstacle_path;
+
+		typedef struct One_Way {					//step rule of the floor for junction_graph::plan()
+			const scenario* floor;
+			bool operator()(int from, int to) const { return floor->one_way(from, to); }
+		}One_Way;
+
+		int uniform(int n) {						//0 .. n-1
+			return splitmix64(_state) % n;
+		}
+
+		int cell(int x, int y) const {
+			return _map[y*_params.size_x + x];
+		}
+
+		void build_map() {
+			int size_x = _params.size_x;
+			int size_y = _params.size_y;
+			_map.assign(size_x*size_y, -1);
+			_grid_cell.assign(1, -1);
+			_row_direction.assign(size_y, 0);
+			_column_direction.assign(size_x*size_y, 0);
+			_open_columns.clear();
+			_aisle_rows.clear();
+			std::vector<int> column(size_x, 0);			//direction of the open columns
+			for (int x = 0; x < size_x; x++) {
+				if (x == 0 || x == size_x - 1 || (x % _params.cross_aisle) == 0) {
+					column[x] = (_open_columns.size() % 2 == 0) ? -1 : 1;
+					_open_columns.push_back(x);
+				}
+			}
+			int grid = 1;
+			for (int y = 0; y < size_y; y++) {
+				bool aisle = (y % 2 == 0) || y == size_y - 1;
+				if (aisle) {
+					_row_direction[y] = (_aisle_rows.size() % 2 == 0) ? 1 : -1;
+					_aisle_rows.push_back(y);
+				}
+				for (int x = 0; x < size_x; x++) {
+					if (column[x] != 0) {
+						_column_direction[y*size_x + x] = column[x];
+					}
+					else if (!aisle && uniform(100) < _params.opening) {
+						_column_direction[y*size_x + x] = (x % 2 == 0) ? 1 : -1;	//gap between two aisles
+					}
+					if (aisle || _column_direction[y*size_x + x] != 0) {
+						_map[y*size_x + x] = grid++;
+						_grid_cell.push_back(y*size_x + x);
+					}
+				}
+			}
+		}
+
+		//one-way step from x, y, -1 if there is none in that direction
+		int step(int x, int y, int dx, int dy) const {
+			int nx = x + dx;
+			int ny = y + dy;
+			if (nx < 0 || ny < 0 || nx >= _params.size_x || ny >= _params.size_y || cell(nx, ny) == -1) {
+				return -1;
+			}
+			bool allowed = (dx != 0) ? (_row_direction[y] == dx) :
+						   (_column_direction[y*_params.size_x + x] == dy || _column_direction[ny*_params.size_x + nx] == dy);
+			return allowed ? ny*_params.size_x + nx : -1;
+		}
+
+		bool one_way(int from, int to) const {		//robots may step from grid to its neighbour grid
+			int x = _grid_cell[from] % _params.size_x;
+			int y = _grid_cell[from] / _params.size_x;
+			return step(x, y, grid_x(to) - x, _grid_cell[to] / _params.size_x - y) == _grid_cell[to];
+		}
+
+		bool build_robots() {
+			std::vector<int> cells;
+			for (int i = 0; i < (int)_map.size(); i++) {
+				if (_map[i] != -1) {
+					cells.push_back(i);
+				}
+			}
+			if ((int)cells.size() < 2*_params.robots + _params.obstacles) {
+				return false;
+			}
+			shuffle(cells);
+			_robot_path.assign(_params.robots, std::vector<int>());
+			_path_release.assign(_params.robots, 0);
+			junction_graph graph(this);
+			One_Way step = {this};
+			int next = 0;								//cells before next are starts or goals already
+			for (int i = 0; i < _params.robots; i++) {
+				int start = cells[next++];
+				for (int goal = next; _robot_path[i].size() < 2; goal++) {
+					if (goal == (int)cells.size()) {
+						return false;					//nowhere to go from start
+					}
+					graph.plan(_map[start], _map[cells[goal]], _robot_path[i], step);
+					if (_robot_path[i].size() >= 2) {
+						std::swap(cells[next++], cells[goal]);
+					}
+				}
+				_robot_path[i].push_back(-1);
+				_path_release[i] = SCENARIO_RELEASE_FIRST + i*SCENARIO_RELEASE_GAP;
+			}
+			return true;
+		}
+
+		bool build_obstacles() {
+			_obstacle_path.assign(_params.obstacles, std::vector<int>());
+			std::vector<bool> taken(_map.size() + 1, false);	//by grid number: robot starts and obstacle starts
+			for (int i = 0; i < _params.robots; i++) {
+				taken[_robot_path[i][0]] = true;
+			}
+			int columns = _open_columns.size();
+			int rows = _aisle_rows.size();
+			if (columns < 2 || rows < 2) {
+				return _params.obstacles == 0;
+			}
+			for (int i = 0; i < _params.obstacles; i++) {
+				std::vector<int> loop;
+				for (int tries = 0; tries < 100; tries++) {
+					//a loop runs with the one-way directions when its top row and left column
+					//have the same parity and it spans an odd number of rows and columns
+					int c = uniform(columns - 1);
+					int r = uniform(rows - 1);
+					if ((c + r) % 2 != 0) {
+						r = (r > 0) ? r - 1 : r + 1;
+					}
+					if (r >= rows - 1) {
+						continue;
+					}
+					int x2 = c + 1 + 2*uniform(SCENARIO_LOOP_SPAN);
+					int y2 = r + 1 + 2*uniform(SCENARIO_LOOP_SPAN);
+					while (x2 >= columns) x2 -= 2;
+					while (y2 >= rows) y2 -= 2;
+					build_loop(_open_columns[c], _aisle_rows[r], _open_columns[x2], _aisle_rows[y2], r % 2 == 1, loop);
+					int start = uniform(loop.size());
+					if (!taken[loop[start]]) {
+						std::rotate(loop.begin(), loop.begin() + start, loop.end());
+						break;
+					}
+					loop.clear();
+				}
+				if (loop.empty()) {
+					return false;
+				}
+				taken[loop[0]] = true;
+				loop.push_back(loop[0]);			//back to where it started
+				_obstacle_path[i] = loop;
+			}
+			return true;
+		}
+
+		//grids around the rectangle x1..x2, y1..y2 once, east along y1 or reversed
+		void build_loop(int x1, int y1, int x2, int y2, bool reverse, std::vector<int>& loop) {
+			loop.clear();
+			for (int x = x1; x < x2; x++) loop.push_back(cell(x, y1));
+			for (int y = y1; y < y2; y++) loop.push_back(cell(x2, y));
+			for (int x = x2; x > x1; x--) loop.push_back(cell(x, y2));
+			for (int y = y2; y > y1; y--) loop.push_back(cell(x1, y));
+			if (reverse) {
+				std::reverse(loop.begin(), loop.end());
+			}
+		}
+
+		void shuffle(std::vector<int>& values) {	//Fisher-Yates
+			for (int i = values.size() - 1; i > 0; i--) {
+				std::swap(values[i], values[uniform(i + 1)]);
+			}
+		}
+
+		static void write_row(FILE* out, const int* values, int count, int length) {
+			fprintf(out, "\t{");
+			for (int i = 0; i < length; i++) {
+				fprintf(out, "%s%d", i ? "," : "", i < count ? values[i] : -1);
+			}
+			fprintf(out, "},\n");
+		}
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef SEEDED_RANDOM_CPP
+#define SEEDED_RANDOM_CPP
+
+#include <stdint.h>
+
+//splitmix64: next number of the sequence started by a seed, the same on every
+//platform. Each user keeps its own state, so draws of one never shift another.
+static inline uint64_t splitmix64(uint64_t& state) {
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+#endif
@@ -1,44 +1,70 @@
 #include "systemc.h"
+#include "bulk_fifo.cpp"
+#include "path_codec.cpp"
+#include "map_file.cpp"
+#include "static_map.cpp"
+#include "junction_graph.cpp"
+#include "zone_map.cpp"
+#include "speed_schedule.cpp"
+#include "telemetry.cpp"
+#include "profiler.cpp"
+#include "kpi.cpp"
+#include "state_hash.cpp"
+#include "link_health.cpp"
+#include "frame.cpp"
+#include "dirty_set.cpp"
+#include "link_channel.cpp"
+#include "latency_trace.cpp"
 
-template<int map_size_x, int map_size_y, int num_of_robots> class server:public sc_module {
+#define ROBOT_CLOCKS_PER_GRID 100	//clocks to cross one grid at full speed
+#define SPEED_GREEDY 0				//speed to reach the next intersection in the expected time
+#define SPEED_SCHEDULE 1			//speeds planned for arrival slots at every intersection
+
+template<int map_size_x, int map_size_y, int num_of_robots, int path_length, class map_type = map_view> class server:public sc_module {
 	public:
 		//PORTS
 		sc_in<bool> clock;
 		sc_in<bool> tx_ack[num_of_robots];
 		sc_out<bool> tx_flag[num_of_robots];
-		sc_out<sc_uint<16> > tx_data[num_of_robots];
+		sc_out<frame_word> tx_data[num_of_robots];
 		sc_out<bool> rx_ack[num_of_robots];
 		sc_in<bool> rx_flag[num_of_robots];
-		sc_in<sc_uint<16> > rx_data[num_of_robots];
-		sc_fifo_out<int> fifo_data[num_of_robots];
+		sc_in<frame_word> rx_data[num_of_robots];
+		bulk_fifo_out<int> fifo_data[num_of_robots];
 		
 		//CONSTRUCTOR
 		SC_HAS_PROCESS(server);
 		
-		server(sc_module_name name, const int* map_ptr, const int* robot_path_ptr):
-		sc_module(name), _map_ptr(map_ptr), _robot_path_ptr(robot_path_ptr) {
+		server(sc_module_name name, const map_type* map, const junction_graph* graph, const zone_map* zones,
+			   const int* robot_path_ptr, const int* path_release_ptr, const int* node_order_ptr, int num_node_orders, int speed_policy,
+			   telemetry_publisher* telemetry, kpi_collector* kpi, state_hasher* hash, data_channel* channel = 0,
+			   latency_trace* trace = 0):
+		sc_module(name), _map(map), _zones(zones), _robot_path_ptr(robot_path_ptr), _health("server", num_of_robots),
+		_speed_policy(speed_policy), _telemetry(telemetry), _kpi(kpi), _hash(hash), _channel(channel), _trace(trace) {
 			SC_METHOD(prc_update);
 			sensitive << clock.pos();
 			
+			SC_METHOD(prc_publish);
+			sensitive << clock.neg();
+			
 			SC_THREAD(prc_tx);
-			sensitive << tx_ack[0].pos() << tx_ack[1].pos() << tx_ack[2].pos() << tx_ack[3].pos();
 			
 			SC_THREAD(prc_rx);
-			sensitive << rx_flag[0].pos() << rx_flag[1].pos() << rx_flag[2].pos() << rx_flag[3].pos();
-
-			for (int x = 0; x < map_size_x; x++) {
-				for (int y = 0; y < map_size_y; y++) {
-					_map_data[x][y] = *(_map_ptr + y*map_size_x + x);	//store map data locally
-				}
+			for (int i = 0; i < num_of_robots; i++) {
+				sensitive << rx_flag[i].pos();
 			}
-			
+
 			for (int i = 0; i < num_of_robots; i++) {			//initialize all robots
-				for (int o = 0; o < 23; o++) {
-					_robot_path[i][o] = *(_robot_path_ptr + i*23 + o);	//store robot path data locally
-					if (*(_robot_path_ptr + i*23 + o) == -1) {
+				for (int o = 0; o < path_length; o++) {
+					_robot_path[i][o] = *(_robot_path_ptr + i*path_length + o);	//store robot path data locally
+					if (*(_robot_path_ptr + i*path_length + o) == -1) {
+						_path_length[i] = o;
 						break;
 					}
 				}
+				_path_release[i] = *(path_release_ptr + i);
+				_path_sent[i] = 0;
+				_path_index[i] = 0;
 				
 				_tx_table[i].status = 7;						//init tx_table
 				_tx_table[i].modified = false;
@@ -51,9 +77,27 @@ template<int map_size_x, int map_size_y, int num_of_robots> class server:public
 				_main_table[i].speed = 0;
 				
 				_node_intersect_index[i] = 0;
+				_parked[i] = -1;
+				_health.name_link(i, "Robot_" + std::to_string(i+1));
+			}
+			
+			init_node_table(graph, node_order_ptr, num_node_orders);
+			init_zones();
+			
+			if (_hash) {
+				const char* fields[HASH_FIELDS] = {"server.status", "server.current_grid", "server.next_grid", "server.speed",
+					"server.path_index", "server.path_sent", "server.node_index", "server.tx_status", "server.rx_status",
+					"server.commanded", "server.node_order"};
+				for (int k = 0; k < HASH_FIELDS; k++) {
+					_hash_field[k] = _hash->add_field(fields[k]);
+				}
+				for (int i = 0; i < num_of_robots; i++) {
+					_hash_robot[i] = _hash->add_agent("robot_" + std::to_string(i+1));
+				}
+				for (int node = 0; node < _num_nodes; node++) {
+					_hash_node.push_back(_hash->add_agent("node_" + std::to_string(_node_order_table[node].node_num)));
+				}
 			}
-			_tx_counter = 0;
-			_rx_counter = 0;
 		}
 
 	private:
@@ -77,75 +121,316 @@ template<int map_size_x, int map_size_y, int num_of_robots> class server:public
 			int robot_time_expected[num_of_robots];
 		}Node;
 		
-		const int* _map_ptr;						//pointer to map data
-		int _map_data[map_size_x][map_size_y];		//locally stored map data
+		typedef struct Zone_Handoff {	//robot offered to the zone it crossed into
+			int robot;
+			int from;			//zone that owns the robot until the handoff is accepted
+			int to;
+			int grid;			//grid the robot crossed into
+			int clock;
+		}Zone_Handoff;
+		
+		typedef struct Zone {
+			std::vector<int> robots;			//robots owned by the zone, in robot order
+			std::vector<int> nodes;				//intersections inside the zone
+			std::vector<Zone_Handoff> inbox;	//offered robots, not yet accepted
+			int handoffs;						//robots accepted from other zones
+		}Zone;
+		
+		const map_type* _map;						//shared read-only map, or the one baked in
+		const zone_map* _zones;						//zone of every grid
+		std::vector<Zone> _zone;
+		int _robot_zone[num_of_robots];				//zone owning each robot
 		const int* _robot_path_ptr;					//pointer to robot path data
-		int _robot_path[num_of_robots][23];			//parameterized robots path (hard-coded for phase 1)
+		int _robot_path[num_of_robots][path_length];	//parameterized robots path, -1 terminated
 		Robot_Main_Status _main_table[num_of_robots];
+		int _path_length[num_of_robots];			//number of grids in each robots path
+		int _path_sent[num_of_robots];				//grids of the path already sent to processing
+		int _path_index[num_of_robots];				//index of the current grid in the path
 		
-		int _tx_counter;
-		int _rx_counter;
+		dirty_set<num_of_robots> _tx_dirty;			//robots with statuses to send
+		dirty_set<num_of_robots> _rx_dirty;			//robots with received statuses to handle
 		Robot_Status _tx_table[num_of_robots];
 		Robot_Status _rx_table[num_of_robots];
+		frame_queue _tx_queue[num_of_robots];		//statuses for the next frame to each robot
+		frame_queue _rx_queue[num_of_robots];		//statuses received since the last clock
 		sc_event tx_signal;
+		link_health _health;						//handshake retries on the robot links
 
 		int _clock_count = -1;
-		Node _node_order_table[6] =
-		{
-			{18, {1, 0, -1, -1}, {6, 7, -1, -1}, {6, 7, -1, -1}},
-			{26, {2, 3, 0, -1}, {2, 2, 5, -1}, {2, 2, 5, -1}},
-			{31, {1, 2, 0, -1}, {2, 5, 2, -1}, {2, 5, 2, -1}},
-			{39, {2, 3, 0, -1}, {2, 6, 2, -1}, {2, 6, 2, -1}},
-			{45, {3, 2, -1, -1}, {3, 3, -1, -1}, {3, 3, -1, -1}},
-			{48, {3, 2, -1, -1}, {2, 3, -1, -1},  {2, 3, -1, -1}}
-		};
-		int _node_intersect[num_of_robots][6] =
-		{
-			{18, 31, 26, 39, -1},
-			{18, 31, -1},
-			{39, 26, 31, 45, 48, -1},
-			{48, 45, 39, 26, -1}
-		};
+		int _occupancy = 0;							//changes whenever a blocked robot could be free to move
+		int _parked[num_of_robots];					//_occupancy when the robot was found blocked, -1 if moving
+		std::vector<Node> _node_order_table;			//intersections, derived from the junction graph
+		int _num_nodes;
+		std::vector<int> _node_intersect[num_of_robots];	//intersections on each robots path, -1 terminated
 		int _node_intersect_index[num_of_robots];
+		int _path_release[num_of_robots];			//clock count at which each robot gets its path, -1 once released
+		int _speed_policy;
+		speed_schedule _schedule;
+		telemetry_publisher* _telemetry;			//live state feed, 0 if disabled
+		kpi_collector* _kpi;						//fleet performance figures, 0 if disabled
+		state_hasher* _hash;						//per tick state hashes, 0 if disabled
+		data_channel* _channel;						//impaired data path to processing, 0 if ideal
+		latency_trace* _trace;						//status latencies, 0 if disabled
+		enum {HASH_STATUS, HASH_CURRENT_GRID, HASH_NEXT_GRID, HASH_SPEED, HASH_PATH_INDEX, HASH_PATH_SENT,
+			  HASH_NODE_INDEX, HASH_TX_STATUS, HASH_RX_STATUS, HASH_COMMANDED, HASH_NODE_ORDER, HASH_FIELDS};
+		int _hash_field[HASH_FIELDS];
+		int _hash_robot[num_of_robots];
+		std::vector<int> _hash_node;
 		
 		void prc_tx() {
+			PROFILE_THREAD("server::prc_tx");
 			while (1) {
-				wait(tx_signal);
-				while (_tx_counter > 0) {					//if recieved data
-					for (int i = 0; i < num_of_robots; i++) {	//loop through tx table
-						if (_tx_table[i].modified) {
-							tx_flag[i] = 1;						//set tx flag
-							tx_data[i] = _tx_table[i].status;	//write data to tx channel
-							wait();								//wait for ack bit from robot
-							if (tx_ack[i] == 1) {
-								_tx_table[i].modified = false;	//if ack was found,
-								_tx_counter--;					//decrement tx_counter
-							}
-							tx_flag[i] = 0;						//clear tx flag
-							wait(SC_ZERO_TIME);
-							break;					//note: if ack was not recieved,
-						}							//process will keep sending until successful
+				PROFILE_WAIT(wait(tx_signal));
+				while (!_tx_dirty.empty()) {				//statuses waiting to be sent
+					int i = next_tx();
+					if (i == num_of_robots) {
+						sc_time retry = next_retry();
+						if (retry == SC_ZERO_TIME) {		//nothing waiting
+							_tx_dirty.clear();
+							break;
+						}
+						PROFILE_WAIT(wait(retry - sc_time_stamp(), tx_signal));	//every waiting word is backing off
+						continue;
+					}
+					int sent = _tx_queue[i].framed();		//statuses in this frame
+					tx_flag[i] = 1;						//set tx flag
+					tx_data[i] = _tx_queue[i].word();	//write frame to tx channel
+					for (int k = 0; _trace && k < sent; k++) {
+						_trace->stamp(i, _tx_queue[i].tag(k), _tx_queue[i].status(k), TRACE_SENT);
+					}
+					_health.sent(i);
+					PROFILE_WAIT(wait(_health.timeout(), tx_ack[i].posedge_event()));	//wait for ack bit from robot
+					if (tx_ack[i] == 1) {
+						_health.acked(i);
+						_tx_queue[i].acked(sent);		//if ack was found,
+					}
+					else if (!_health.timed_out(i)) {	//otherwise try again after a backoff,
+						_tx_queue[i].clear();			//or give the frame up on a dead link
 					}
+					if (_tx_queue[i].empty() && _tx_table[i].modified) {
+						_tx_table[i].modified = false;	//everything sent
+						_tx_dirty.erase(i);
+					}
+					tx_flag[i] = 0;						//clear tx flag
+					PROFILE_WAIT(wait(SC_ZERO_TIME));
 				}
 			}
 		}
 		
+		int next_tx() {								//first robot with a word and a link ready for it
+			for (int i = _tx_dirty.first(); i != -1; i = _tx_dirty.next(i)) {
+				if (_health.ready(i)) {
+					return i;
+				}
+			}
+			return num_of_robots;
+		}
+		
+		sc_time next_retry() {						//earliest a waiting word can be tried again, 0 if none waits
+			sc_time first = SC_ZERO_TIME;
+			for (int i = _tx_dirty.first(); i != -1; i = _tx_dirty.next(i)) {
+				if (first == SC_ZERO_TIME || _health.retry_at(i) < first) {
+					first = _health.retry_at(i);
+				}
+			}
+			return first;
+		}
+		
+		void send_status(int robot, int status, int grid = FRAME_NONE, int speed = FRAME_NONE) {
+			_tx_table[robot].status = status;
+			_tx_table[robot].modified = 1;
+			_tx_dirty.insert(robot);
+			int tag = _trace ? _trace->open(robot, TRACE_SERVER, status) : 0;
+			_tx_queue[robot].push(status, grid, speed, tag);	//goes out with anything else still queued
+		}
+		
 		void prc_rx() {
+			PROFILE_THREAD("server::prc_rx");
 			while(1) {
-				wait();
+				PROFILE_WAIT(wait());
 				for (int i = 0; i < num_of_robots; i++) {
 					if (rx_flag[i] == 1) {
 						rx_ack[i] = 1;								//send ack bit
-						_rx_table[i].status = rx_data[i].read();	//update rx table
-						_rx_table[i].modified = 1;
-						wait(SC_ZERO_TIME);
+						bool waiting = !_rx_queue[i].empty();
+						int first = _rx_queue[i].size();
+						if (_rx_queue[i].receive(rx_data[i].read()) > 0 && !waiting) {	//new statuses, not a repeat
+							_rx_table[i].modified = 1;				//update rx table
+							_rx_dirty.insert(i);
+						}
+						for (int k = first; _trace && k < _rx_queue[i].size(); k++) {
+							_trace->stamp(i, _rx_queue[i].tag(k), _rx_queue[i].status(k), TRACE_RECEIVED);
+						}
+						PROFILE_WAIT(wait(SC_ZERO_TIME));
 						rx_ack[i] = 0;
-						_rx_counter++;
 					}
 				}
 			}
 		}
 		
+		//Intersections are the junctions where robot paths meet from different sides.
+		//Each robot's distance is counted in grids from its previous intersection (or
+		//its start). Robots cross in the order given by node_order_ptr rows of
+		//{node, robots...}, any others by when they are expected to arrive.
+		void init_node_table(const junction_graph* graph, const int* node_order_ptr, int num_node_orders) {
+			std::vector<int> junctions;
+			find_junctions(_map, graph, junctions);
+			_num_nodes = junctions.size();
+			_node_order_table.resize(_num_nodes);
+			_schedule.init(num_of_robots, _num_nodes);
+			std::vector<int> arrival(_num_nodes*num_of_robots, -1);
+			std::vector<int> distance(_num_nodes*num_of_robots, -1);
+			for (int i = 0; i < num_of_robots; i++) {
+				int previous = 0;
+				for (int o = 1; o < _path_length[i]; o++) {	//a robot starting on an intersection is already inside it
+					int node = std::lower_bound(junctions.begin(), junctions.end(), _robot_path[i][o]) - junctions.begin();
+					if (node < _num_nodes && junctions[node] == _robot_path[i][o]) {
+						_node_intersect[i].push_back(junctions[node]);
+						_schedule.add_leg(i, node, o);
+						distance[node*num_of_robots + i] = o - previous;
+						arrival[node*num_of_robots + i] = _path_release[i] + o*ROBOT_CLOCKS_PER_GRID;
+						previous = o;
+					}
+				}
+				_node_intersect[i].push_back(-1);
+			}
+			for (int node = 0; node < _num_nodes; node++) {
+				std::vector<std::pair<int, int> > order;				//(priority, robot)
+				const int* priority = 0;
+				for (int row = 0; row < num_node_orders; row++) {
+					if (*(node_order_ptr + row*(num_of_robots + 1)) == junctions[node]) {
+						priority = node_order_ptr + row*(num_of_robots + 1) + 1;
+					}
+				}
+				for (int i = 0; i < num_of_robots; i++) {
+					if (distance[node*num_of_robots + i] == -1) {
+						continue;
+					}
+					int rank = arrival[node*num_of_robots + i] + num_of_robots;
+					for (int o = 0; priority && o < num_of_robots; o++) {
+						if (priority[o] == i) {
+							rank = o - num_of_robots;					//listed robots go first
+						}
+					}
+					order.push_back(std::make_pair(rank, i));
+				}
+				std::sort(order.begin(), order.end());
+				_node_order_table[node].node_num = junctions[node];
+				if (_kpi) {
+					_kpi->add_intersection(junctions[node]);
+				}
+				for (int o = 0; o < num_of_robots; o++) {
+					int robot = (o < (int)order.size()) ? order[o].second : -1;
+					_node_order_table[node].robot_order[o] = robot;
+					_node_order_table[node].robot_distance[o] = (robot == -1) ? -1 : distance[node*num_of_robots + robot];
+					_node_order_table[node].robot_time_expected[o] = _node_order_table[node].robot_distance[o];
+					if (robot != -1) {
+						_schedule.add_order(node, robot);
+					}
+				}
+			}
+		}
+		
+		//Every robot is owned by the zone of its current grid and every intersection
+		//by the zone it lies in. A zone only steps the robots it owns and only
+		//searches its own intersections and robots.
+		void init_zones() {
+			_zone.resize(_zones->num_zones());
+			for (int z = 0; z < (int)_zone.size(); z++) {
+				_zone[z].handoffs = 0;
+			}
+			for (int i = 0; i < num_of_robots; i++) {
+				_robot_zone[i] = _zones->zone(_main_table[i].current_grid);
+				_zone[_robot_zone[i]].robots.push_back(i);
+			}
+			for (int node = 0; node < _num_nodes; node++) {
+				_zone[_zones->zone(_node_order_table[node].node_num)].nodes.push_back(node);
+			}
+		}
+		
+		void find_junctions(const map_view*, const junction_graph* graph, std::vector<int>& junctions) {
+			graph->conflict_junctions((const int*)_robot_path, path_length, num_of_robots, junctions);
+		}
+		
+		template<int x, int y, const int (&cells)[y][x], int robots, int length, const int (&paths)[robots][length]>
+		void find_junctions(const static_map<x, y, cells, robots, length, paths>* map, const junction_graph*, std::vector<int>& junctions) {
+			junctions.assign(map->junctions(), map->junctions() + map->num_junctions());	//worked out by the compiler
+		}
+		
+		int find_node(int grid) {					//intersection on a grid, _num_nodes if none
+			return find_node(_map, grid);
+		}
+		
+		int find_node(const map_view*, int grid) {
+			int zone = _zones->zone(grid);
+			for (int n = 0; zone != -1 && n < (int)_zone[zone].nodes.size(); n++) {
+				if (_node_order_table[_zone[zone].nodes[n]].node_num == grid) {
+					return _zone[zone].nodes[n];
+				}
+			}
+			return _num_nodes;
+		}
+		
+		template<int x, int y, const int (&cells)[y][x], int robots, int length, const int (&paths)[robots][length]>
+		int find_node(const static_map<x, y, cells, robots, length, paths>* map, int grid) {
+			int node = map->junction_of(grid);		//same order as _node_order_table
+			return (node == -1) ? _num_nodes : node;
+		}
+		
+		bool grid_occupied(int grid) {				//robot on the grid, other than ones not started or done
+			int zone = _zones->zone(grid);
+			if (zone == -1) {
+				return false;
+			}
+			for (int r = 0; r < (int)_zone[zone].robots.size(); r++) {
+				int robot = _zone[zone].robots[r];
+				if (_main_table[robot].current_grid == grid && _main_table[robot].status != 6 && _main_table[robot].status != 5) {
+					return true;
+				}
+			}
+			for (int h = 0; h < (int)_zone[zone].inbox.size(); h++) {	//still owned by the zone it came from
+				int robot = _zone[zone].inbox[h].robot;
+				if (_main_table[robot].current_grid == grid && _main_table[robot].status != 6 && _main_table[robot].status != 5) {
+					return true;
+				}
+			}
+			return false;
+		}
+		
+		//HANDOFF: the owning zone offers a robot that crossed into another zone, the
+		//new zone accepts it after the rx phase and the old zone releases it. Until
+		//then the old zone keeps stepping it and the new zone sees it on its grids.
+		void offer_handoff(int robot) {
+			Zone_Handoff handoff;
+			handoff.robot = robot;
+			handoff.from = _robot_zone[robot];
+			handoff.to = _zones->zone(_main_table[robot].current_grid);
+			handoff.grid = _main_table[robot].current_grid;
+			handoff.clock = _clock_count;
+			_zone[handoff.to].inbox.push_back(handoff);
+		}
+		
+		void accept_handoffs() {
+			for (int z = 0; z < (int)_zone.size(); z++) {
+				for (int h = 0; h < (int)_zone[z].inbox.size(); h++) {
+					const Zone_Handoff& handoff = _zone[z].inbox[h];
+					std::vector<int>& robots = _zone[z].robots;
+					robots.insert(std::lower_bound(robots.begin(), robots.end(), handoff.robot), handoff.robot);
+					release_handoff(handoff);
+					_zone[z].handoffs++;
+					cout << "Time " << sc_time_stamp() << " | "
+						 << "Robot_" << (handoff.robot+1) << " handed off from zone " << handoff.from
+						 << " to zone " << handoff.to << " at grid " << handoff.grid << endl;
+				}
+				_zone[z].inbox.clear();
+			}
+		}
+		
+		void release_handoff(const Zone_Handoff& handoff) {
+			std::vector<int>& robots = _zone[handoff.from].robots;
+			robots.erase(std::lower_bound(robots.begin(), robots.end(), handoff.robot));
+			_robot_zone[handoff.robot] = handoff.to;
+		}
+		
 		void remove_from_intersection(int i, int robot) {
 			for (int o = 0; o < num_of_robots-1; o++) {
 				_node_order_table[i].robot_order[o] = _node_order_table[i].robot_order[o+1];
@@ -155,31 +440,16 @@ template<int map_size_x, int map_size_y, int num_of_robots> class server:public
 		}
 		
 		void update_speeds(int i, int exclude) {
-			if (i == 6) {		//robot has gone through all intersections
+			PROFILE_FUNCTION("server::update_speeds");
+			if (_speed_policy == SPEED_SCHEDULE) {
+				return;					//speeds follow the schedule, see schedule_speeds()
+			}
+			if (i == _num_nodes) {		//robot has gone through all intersections
 				if (_tx_table[exclude].modified != 1 && 2000 != _main_table[exclude].speed &&
 					_main_table[exclude].status != 5 && _main_table[exclude].status != 6 && _main_table[exclude].status != 7) {
-					int diff_speed = (_main_table[exclude].speed - 2000)/50;
-					int inc = -1;
-					if (diff_speed < 0) {
-						inc = 2;
-						diff_speed *= -1;
-						diff_speed /= 2;
-					}
-					else {
-						inc = 1;
-						diff_speed -= 1;
-					}
-					for (diff_speed -= 1; diff_speed >= 0; diff_speed--) {
-						fifo_data[exclude].write(inc);				//send speed inc/dec to robot
-					}
-					fifo_data[exclude].write(-1);
-					_tx_table[exclude].status = 10;
-					_tx_table[exclude].modified = 1;
-					_tx_counter++;
-					
-					_main_table[exclude].speed = 2000;
-					return;
+					send_speed(exclude, 2000);
 				}
+				return;			//there is no node table entry to update
 			}
 			int total_time = 0;
 			for (int o = 0; o < num_of_robots; o++) {
@@ -209,211 +479,322 @@ template<int map_size_x, int map_size_y, int num_of_robots> class server:public
 				if (_tx_table[robot].modified != 1 && target_speed != _main_table[robot].speed
 					&& robot != exclude
 					&& (_main_table[robot].status == 0 || _main_table[robot].status == 2 || _main_table[robot].status == 8)) {
-					int diff_speed = (_main_table[robot].speed - target_speed)/50;
-					int inc = -1;							//2 = +100 mm/s, 1 = -50 mm/s
-					if (diff_speed < 0) {
-						inc = 2;
-						diff_speed *= -1;
-						diff_speed /= 2;
-					}
-					else {
-						inc = 1;
-						diff_speed -= 1;
-					}
-					for (diff_speed -= 1; diff_speed >= 0; diff_speed--) {
-						fifo_data[robot].write(inc);				//send speed inc/dec to robot
-					}
-					fifo_data[robot].write(-1);
-					_tx_table[robot].status = 10;
-					_tx_table[robot].modified = 1;
-					_tx_counter++;
-					
-					_main_table[robot].speed = target_speed;
+					send_speed(robot, target_speed);
 				}
 			}
 		}
 		
-		void prc_update() {			
-			while (_rx_counter > 0) {					//if recieved data
-				for (int i = 0; i < num_of_robots; i++) {	//loop through rx table
-					if (_rx_table[i].modified) {
-						if (_main_table[i].status != 5) {
-							int intersection;
-							for (intersection = 0; intersection < 6; intersection++) {
-								if (_node_order_table[intersection].node_num == _node_intersect[i][_node_intersect_index[i]]) {
-									break;
-								}
-							}
-							int intersection_order = 0;
-							for (int o = 0; o < num_of_robots; o++) {
-								if (i == _node_order_table[intersection].robot_order[o]) {
-									intersection_order = o;
-									break;
-								}
+		//send every robot that is free to take one the speed of its current plan
+		void schedule_speeds() {
+			PROFILE_FUNCTION("server::schedule_speeds");
+			_schedule.solve(_clock_count);
+			for (int i = 0; i < num_of_robots; i++) {
+				if (_tx_table[i].modified == 1 || _schedule.target(i) == _schedule.commanded(i) ||
+					(_main_table[i].status != 0 && _main_table[i].status != 2 && _main_table[i].status != 8)) {
+					continue;
+				}
+				int speed_data[81];
+				int n;
+				speed_data[0] = 10;						//SPEED message
+				int speed = _schedule.profile(i, &speed_data[1], 80, n);
+				if (n > 0 && send_speed_data(i, speed_data, n + 1, speed)) {
+					_schedule.command(i, speed);
+				}
+			}
+		}
+		
+		bool send_speed(int robot, int target_speed) {
+			int speed_data[81];
+			int n = 0;
+			speed_data[n++] = 10;					//SPEED message
+			int diff_speed = (_main_table[robot].speed - target_speed)/50;
+			int inc = -1;							//2 = +100 mm/s, 1 = -50 mm/s
+			if (diff_speed < 0) {
+				inc = 2;
+				diff_speed *= -1;
+				diff_speed /= 2;
+			}
+			else {
+				inc = 1;
+				diff_speed -= 1;
+			}
+			for (diff_speed -= 1; diff_speed >= 0 && n < 81; diff_speed--) {
+				speed_data[n++] = inc;				//speed inc/dec tokens for the robot
+			}
+			return send_speed_data(robot, speed_data, n, target_speed);
+		}
+		
+		bool send_speed_data(int robot, const int* speed_data, int n, int target_speed) {
+			if (!write_data(robot, speed_data, n)) {
+				cout << "Time " << sc_time_stamp() << " | "
+					 << "Robot_" << (robot+1) << " speed data deferred, link full" << endl;
+				return false;						//retried on the next speed update
+			}
+			send_status(robot, 10, FRAME_NONE, target_speed);
+			
+			_main_table[robot].speed = target_speed;
+			return true;
+		}
+		
+		bool write_data(int robot, const int* data, int n) {
+			if (_channel) {
+				return _channel->write(robot, data, n, fifo_data[robot].num_free());
+			}
+			return fifo_data[robot].write_n(data, n);
+		}
+		
+		void prc_publish() {			//data written this clock is read by processing on the next one
+			for (int i = 0; i < num_of_robots; i++) {
+				if (_channel) {
+					_channel->deliver(i, fifo_data[i]);	//what has arrived by now
+				}
+				fifo_data[i].publish();
+			}
+		}
+		
+		void prc_update() {
+			PROFILE_PROCESS("server::prc_update");
+			PROFILE_DELTA();
+			for (int i = _rx_dirty.first(); i != -1; i = _rx_dirty.next(i)) {	//robots with received statuses, in robot order
+				for (int k = 0; k < _rx_queue[i].size(); k++) {		//statuses in the order they were sent
+					_rx_table[i].status = _rx_queue[i].status(k);
+					if (_trace) {
+						_trace->applied(i, _rx_queue[i].tag(k), _rx_table[i].status);
+					}
+					if (_main_table[i].status != 5) {
+						int intersection = find_node(_node_intersect[i][_node_intersect_index[i]]);
+						int intersection_order = 0;
+						for (int o = 0; intersection < _num_nodes && o < num_of_robots; o++) {
+							if (i == _node_order_table[intersection].robot_order[o]) {
+								intersection_order = o;
+								break;
 							}
-							
-							switch(_rx_table[i].status) {
-								case 0:
-								case 3:
+						}
+					
+						switch(_rx_table[i].status) {
+							case 0:
+							case 3:
+								if (intersection < _num_nodes) {	//no entry once past the last intersection
 									_node_order_table[intersection].robot_time_expected[intersection_order] += 1;
-									_main_table[i].status = 7;
-									_main_table[i].speed = 0;
-									update_speeds(intersection, i);
-									break;
-								case 1:
-									if (robot_move(i)) {
-										_main_table[i].status = 0;
-										_tx_table[i].status = 9;
-										_tx_table[i].modified = 1;
-										_tx_counter++;
-									}
-									else {
-										_main_table[i].status = 3;
-										_tx_table[i].status = 8;
-										_tx_table[i].modified = 1;
-										_tx_counter++;
-									}
-									break;
-								case 2:
-									if (robot_move(i)) {
-										_main_table[i].status = 0;
-										_tx_table[i].status = 5;
-										_tx_table[i].modified = 1;
-										_tx_counter++;
-									}
-									else {
-										_main_table[i].status = 3;
-										_tx_table[i].status = 7;
-										_tx_table[i].modified = 1;
-										_tx_counter++;
-									}
-									break;
-								case 4:
-									_main_table[i].status = 2;
-									_main_table[i].current_grid = _main_table[i].next_grid;
-									_main_table[i].next_grid = next_grid(i);
-									for (int o = 0; o < num_of_robots; o++) {
-										if (_node_order_table[intersection].robot_order[o] == i) {
-											if (--_node_order_table[intersection].robot_distance[o] == 0) {
-												_node_order_table[intersection].robot_distance[o] = 1;
-											}
-											if (--_node_order_table[intersection].robot_time_expected[o] == 0) {
-												_node_order_table[intersection].robot_time_expected[o] = 1;
-											}
+								}
+								_main_table[i].status = 7;
+								_main_table[i].speed = 0;
+								_schedule.stopped(i);
+								update_speeds(intersection, i);
+								break;
+							case 1:
+								if (robot_move(i)) {
+									_main_table[i].status = 0;
+									_schedule.resumed(i);
+									send_status(i, 9);
+								}
+								else {
+									_main_table[i].status = 3;
+									send_status(i, 8);
+								}
+								break;
+							case 2:
+								if (robot_move(i)) {
+									_main_table[i].status = 0;
+									send_status(i, 5);
+								}
+								else {
+									_main_table[i].status = 3;
+									send_status(i, 7);
+								}
+								break;
+							case 4:
+								_main_table[i].status = 2;
+								_main_table[i].current_grid = (_rx_queue[i].grid() != FRAME_NONE) ?
+															  _rx_queue[i].grid() : _main_table[i].next_grid;	//the grid processing crossed into
+								_main_table[i].next_grid = next_grid(i);
+								_path_index[i]++;
+								if (_zones->zone(_main_table[i].current_grid) != _robot_zone[i]) {
+									offer_handoff(i);
+								}
+								_schedule.crossed(i, _path_index[i]);
+								if (_kpi) {
+									_kpi->crossed(i);
+								}
+								for (int o = 0; intersection < _num_nodes && o < num_of_robots; o++) {
+									if (_node_order_table[intersection].robot_order[o] == i) {
+										if (--_node_order_table[intersection].robot_distance[o] == 0) {
+											_node_order_table[intersection].robot_distance[o] = 1;
+										}
+										if (--_node_order_table[intersection].robot_time_expected[o] == 0) {
+											_node_order_table[intersection].robot_time_expected[o] = 1;
 										}
 									}
-									if (_main_table[i].next_grid == -1) {
-										_main_table[i].status = 5;
-										_tx_table[i].status = 7;
-										_tx_table[i].modified = 1;
-										_tx_counter++;
-									}
-									if (_main_table[i].current_grid == _node_intersect[i][_node_intersect_index[i]]) {
-										remove_from_intersection(intersection, i);
-										update_speeds(intersection, -1);
-										_node_intersect_index[i]++;
+								}
+								if (_main_table[i].next_grid == -1) {
+									_main_table[i].status = 5;
+									_schedule.finished(i);
+									if (_kpi) {
+										_kpi->finished(i, _clock_count);
 									}
-									break;
-								default:
-									break;
-							}
+									send_status(i, 7);
+								}
+								if (_main_table[i].current_grid == _node_intersect[i][_node_intersect_index[i]]) {
+									remove_from_intersection(intersection, i);
+									update_speeds(intersection, -1);
+									_node_intersect_index[i]++;
+								}
+								break;
+							default:
+								break;
 						}
-						_rx_counter--;
-						_rx_table[i].modified = 0;
 					}
 				}
+				_rx_queue[i].clear();
+				_rx_dirty.erase(i);
+				_rx_table[i].modified = 0;
+				_occupancy++;					//grids, intersection orders and handoffs only change here
 			}
+			accept_handoffs();
 			
-			for (int i = 0; i < num_of_robots; i++) {
-				bool robot_moved = robot_move(i);
-				if (_tx_table[i].modified == 0) {
-					int intersection;
-					for (intersection = 0; intersection < 6; intersection++) {
-						if (_node_order_table[intersection].node_num == _node_intersect[i][_node_intersect_index[i]]) {
-							break;
-						}
+			for (int z = 0; z < (int)_zone.size(); z++) {
+				for (int r = 0; r < (int)_zone[z].robots.size(); r++) {
+					int i = _zone[z].robots[r];
+					if (robot_idle(i)) {
+						continue;
 					}
-							
-					switch (_main_table[i].status) {
-						case 0:								//STATE: RESUME
-						case 2:								//STATE: CROSSED
-							if (!robot_moved) {
-								_main_table[i].status = 3;
-								_main_table[i].speed = 0;
-								_tx_table[i].status = 8;
-								_tx_table[i].modified = 1;
-								_tx_counter++;
-							}
-							else {
-								if (_main_table[i].speed == 0) {
-									if (intersection == 6) {
-										update_speeds(intersection, i);
+					bool robot_moved = robot_move(i);
+					if (_tx_table[i].modified == 0) {
+						int intersection = find_node(_node_intersect[i][_node_intersect_index[i]]);
+								
+						switch (_main_table[i].status) {
+							case 0:								//STATE: RESUME
+							case 2:								//STATE: CROSSED
+								if (!robot_moved) {
+									_main_table[i].status = 3;
+									_main_table[i].speed = 0;
+									_schedule.stopped(i);			//processing drops the robot to 0 on STOP2
+									send_status(i, 8);
+								}
+								else {
+									if (_main_table[i].speed == 0) {
+										if (intersection == _num_nodes) {
+											update_speeds(intersection, i);
+										}
+										else {
+											update_speeds(intersection, -1);
+										}
+									}
+								}
+								break;
+							case 3:								//STATE: STOPPED
+							case 8:
+								if (robot_moved) {
+									if (_main_table[i].speed == 0) {
+										if (intersection == _num_nodes) {
+											update_speeds(intersection, i);		//past its last intersection
+										}
+										else {
+											update_speeds(intersection, -1);
+										}
 									}
 									else {
-										update_speeds(intersection, -1);
+										_main_table[i].status = 0;
+										_schedule.resumed(i);
+										send_status(i, 9);
 									}
 								}
-							}
-							break;
-						case 3:								//STATE: STOPPED
-						case 8:
-							if (robot_moved) {
-								if (_main_table[i].speed == 0) {
-									update_speeds(intersection, -1);
-								}
 								else {
-									_main_table[i].status = 0;
-									_tx_table[i].status = 9;
-									_tx_table[i].modified = 1;
-									_tx_counter++;
+									_main_table[i].speed = 0;
+									_parked[i] = _occupancy;
 								}
-							}
-							else {
-								_main_table[i].speed = 0;
-							}
-							break;
-						case 6:								//Special case for start up
-							if (robot_moved) {
-								_main_table[i].status = 8;
-								_tx_table[i].status = 6;
-								_tx_table[i].modified = 1;
-								_tx_counter++;
-							}
-							break;
-						default:
-							break;
+								break;
+							case 6:								//Special case for start up
+								if (robot_moved) {
+									_main_table[i].status = 8;
+									_occupancy++;				//now holds its grid
+									send_status(i, 6);
+								}
+								break;
+							default:
+								break;
+						}
 					}
 				}
 			}
 
 			_clock_count++;
-			if (_clock_count == 101) {
-				send_path(0);
-				_main_table[0].status = 6;
+			for (int i = 0; i < num_of_robots; i++) {
+				if (_path_release[i] != -1 && _clock_count >= _path_release[i]) {
+					if (send_path(i)) {				//if the link is full, try again next clock
+						_main_table[i].status = 6;
+						_schedule.released(i, _clock_count);
+						if (_kpi) {
+							_kpi->released(i, _clock_count);
+						}
+						_path_release[i] = -1;
+					}
+				}
+				else if (_path_release[i] == -1 && _path_sent[i] < _path_length[i] &&
+						 _path_sent[i] - _path_index[i] < PATH_LOOKAHEAD) {
+					send_path_segment(i);			//stream the route ahead of the robot
+				}
+			}
+			
+			_schedule.tick(_clock_count);
+			for (int i = 0; _kpi && i < num_of_robots; i++) {
+				if ((_main_table[i].status == 3 || _main_table[i].status == 7) &&
+					_main_table[i].next_grid == _node_intersect[i][_node_intersect_index[i]]) {
+					_kpi->queued(i, _main_table[i].next_grid);	//held in front of an intersection
+				}
 			}
-			else if (_clock_count == 501) {
-				send_path(1);
-				_main_table[1].status = 6;
+			if (_speed_policy == SPEED_SCHEDULE) {
+				schedule_speeds();
 			}
-			else if (_clock_count == 701) {
-				send_path(2);
-				_main_table[2].status = 6;
+			if (_telemetry) {
+				Telemetry_Server_Robot* robot = (Telemetry_Server_Robot*)_telemetry->begin(TELEMETRY_SERVER, _clock_count);
+				for (int i = 0; i < num_of_robots; i++) {
+					robot[i].status = _main_table[i].status;
+					robot[i].current_grid = _main_table[i].current_grid;
+					robot[i].next_grid = _main_table[i].next_grid;
+					robot[i].speed = _main_table[i].speed;
+				}
+				_telemetry->commit(TELEMETRY_SERVER);
 			}
-			else if (_clock_count == 201) {
-				send_path(3);
-				_main_table[3].status = 6;
+			
+			if (_hash) {
+				hash_state();
 			}
 			
-			if (_tx_counter > 0) {
+			if (!_tx_dirty.empty()) {
 				tx_signal.notify(SC_ZERO_TIME);
 				cout << endl;
 			}
 		}
 		
+		void hash_state() {
+			for (int i = 0; i < num_of_robots; i++) {
+				int agent = _hash_robot[i];
+				_hash->add(_clock_count, _hash_field[HASH_STATUS], agent, _main_table[i].status);
+				_hash->add(_clock_count, _hash_field[HASH_CURRENT_GRID], agent, _main_table[i].current_grid);
+				_hash->add(_clock_count, _hash_field[HASH_NEXT_GRID], agent, _main_table[i].next_grid);
+				_hash->add(_clock_count, _hash_field[HASH_SPEED], agent, _main_table[i].speed);
+				_hash->add(_clock_count, _hash_field[HASH_PATH_INDEX], agent, _path_index[i]);
+				_hash->add(_clock_count, _hash_field[HASH_PATH_SENT], agent, _path_sent[i]);
+				_hash->add(_clock_count, _hash_field[HASH_NODE_INDEX], agent, _node_intersect_index[i]);
+				_hash->add(_clock_count, _hash_field[HASH_TX_STATUS], agent, _tx_table[i].status*2 + _tx_table[i].modified);
+				_hash->add(_clock_count, _hash_field[HASH_RX_STATUS], agent, _rx_table[i].status*2 + _rx_table[i].modified);
+				_hash->add(_clock_count, _hash_field[HASH_COMMANDED], agent, _schedule.commanded(i));
+			}
+			for (int node = 0; node < _num_nodes; node++) {
+				for (int o = 0; o < num_of_robots; o++) {
+					int64_t entry = ((int64_t)_node_order_table[node].robot_order[o] << 40) ^
+									((int64_t)_node_order_table[node].robot_distance[o] << 20) ^
+									_node_order_table[node].robot_time_expected[o];
+					_hash->add(_clock_count, _hash_field[HASH_NODE_ORDER], _hash_node[node], entry, o);
+				}
+			}
+		}
+		
 		int next_grid(int robot) {
 			int new_next_grid = -1;
 			//search for next grid in path
-			for (int i = 0; i < 23; i++) {
+			for (int i = 0; i < path_length - 1; i++) {
 				if (_robot_path[robot][i] == _main_table[robot].next_grid) {
 					new_next_grid = _robot_path[robot][i+1];
 					break;
@@ -422,45 +803,88 @@ template<int map_size_x, int map_size_y, int num_of_robots> class server:public
 			return new_next_grid;
 		}
 		
-		bool robot_move(int robot) {
-			//find the robot that is occupying the next grid (if there is one)
-			int robot2;
-			for (robot2 = 0; robot2 < num_of_robots; robot2++) {
-				if (_main_table[robot2].current_grid == _main_table[robot].next_grid &&
-					_main_table[robot2].status != 6 && _main_table[robot2].status != 5) {
-					break;
-				}
+		//A robot the robot loop has nothing to do for: done, stopped until processing
+		//restarts it, or blocked with nothing changed since robot_move last failed.
+		//A message for any robot or another robot taking its grid re-arms it.
+		bool robot_idle(int robot) {
+			int status = _main_table[robot].status;
+			if (status == 5 || status == 7) {
+				return true;
 			}
-			
+			return (status == 3 || status == 8) && _parked[robot] == _occupancy &&
+				   _main_table[robot].speed == 0 && !_tx_table[robot].modified;
+		}
+		
+		bool robot_move(int robot) {
+			PROFILE_FUNCTION("server::robot_move");
 			if (_main_table[robot].next_grid == _node_intersect[robot][_node_intersect_index[robot]]) {
-				int intersection;
-				for (intersection = 0; intersection < 6; intersection++) {
-					if (_node_order_table[intersection].node_num == _node_intersect[robot][_node_intersect_index[robot]]) {
-						break;
-					}
+				int intersection = find_node(_node_intersect[robot][_node_intersect_index[robot]]);
+				if (intersection == _num_nodes) {
+					return false;							//end of path
 				}
-				if (_node_order_table[intersection].robot_order[0] != robot) {
-					return false;
+				if (_node_order_table[intersection].robot_order[0] != robot && !overtake(intersection, robot)) {
+					return false;							//not this robots turn
 				}
 			}
 			
-			if (robot2 == num_of_robots) {
-				return true;
+			return !grid_occupied(_main_table[robot].next_grid);	//free unless another robot is on the next grid
+		}
+		
+		//Orders follow the planned arrivals, which can put a robot stuck behind the one
+		//waiting at the intersection first in line. A robot waiting in front of a free
+		//intersection goes ahead of a first robot that is stopped anywhere else.
+		bool overtake(int i, int robot) {
+			int first = _node_order_table[i].robot_order[0];
+			int status = _main_table[first].status;
+			if ((status != 3 && status != 8) || _main_table[first].next_grid == _node_order_table[i].node_num ||
+				grid_occupied(_node_order_table[i].node_num)) {
+				return false;
 			}
-			else {
+			int o = 1;
+			while (o < num_of_robots && _node_order_table[i].robot_order[o] != robot) {
+				o++;
+			}
+			if (o == num_of_robots) {
 				return false;
 			}
+			int distance = _node_order_table[i].robot_distance[o];
+			int time = _node_order_table[i].robot_time_expected[o];
+			for (; o > 0; o--) {
+				_node_order_table[i].robot_order[o] = _node_order_table[i].robot_order[o-1];
+				_node_order_table[i].robot_distance[o] = _node_order_table[i].robot_distance[o-1];
+				_node_order_table[i].robot_time_expected[o] = _node_order_table[i].robot_time_expected[o-1];
+			}
+			_node_order_table[i].robot_order[0] = robot;
+			_node_order_table[i].robot_distance[0] = distance;
+			_node_order_table[i].robot_time_expected[0] = time;
+			return true;
 		}
 		
-		void send_path(int robot) {
-			_tx_table[robot].status = 11;
-			_tx_table[robot].modified = 1;
-			_tx_counter++;
-			for (int i = 0; i < 23; i++) {
-				fifo_data[robot].write(_robot_path[robot][i]);
-				if (_robot_path[robot][i] == -1) {
-					break;
-				}
+		bool send_path(int robot) {
+			_path_sent[robot] = 0;
+			if (!send_path_segment(robot)) {
+				return false;
+			}
+			send_status(robot, 11, _robot_path[robot][0]);
+			return true;
+		}
+		
+		bool send_path_segment(int robot) {
+			PROFILE_FUNCTION("server::send_path_segment");
+			int path_data[3 + PATH_SEGMENT];
+			int first = (_path_sent[robot] == 0) ? 0 : _path_sent[robot] - 1;
+			int last = first + PATH_SEGMENT;
+			if (last > _path_length[robot] - 1) {
+				last = _path_length[robot] - 1;
+			}
+			path_data[0] = 11;						//PATH message
+			path_data[1] = (_path_sent[robot] == 0) ? _robot_path[robot][0] : -1;
+			path_data[2] = (last == _path_length[robot] - 1);
+			int n = path_encode(_robot_path[robot], first, last, _map->grid_x_table(), _map->grid_y_table(), &path_data[3], PATH_SEGMENT);
+			if (!write_data(robot, path_data, 3 + n)) {
+				return false;						//retried on the next clock
 			}
+			_path_sent[robot] = last + 1;
+			return true;
 		}
 };
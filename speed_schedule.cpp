@@ -0,0 +1,313 @@
+#ifndef SPEED_SCHEDULE_CPP
+#define SPEED_SCHEDULE_CPP
+
+#include <vector>
+
+#define SCHEDULE_GRID 200000				//distance across one grid
+#define SCHEDULE_CHECK (SCHEDULE_GRID/10)	//robots ask to enter the next grid this far before it
+#define SCHEDULE_SPEED_MAX 2000
+#define SCHEDULE_SPEED_MIN 50
+#define SCHEDULE_SPEED_UP 100				//speed change of one token, one token every SCHEDULE_STEP clocks
+#define SCHEDULE_SPEED_DOWN 50
+#define SCHEDULE_STEP 10
+#define SCHEDULE_MARGIN 20					//clocks kept between two robots using the same intersection
+#define SCHEDULE_TOLERANCE 20000			//progress error that makes a robot plan again
+#define SCHEDULE_STARTUP 30					//clocks from sending a path until the robot can move
+
+//Arrival slots for every robot at every intersection still ahead of it.
+//Robots use an intersection in a fixed order; each one is planned to reach the
+//point where it asks to enter just after the robot before it has left the
+//intersection grid, at the fastest speed that does not get it there early. Only
+//speeds the robot can reach with +100/-50 tokens from what it was last sent are
+//considered, and ramps are one token every SCHEDULE_STEP clocks. Plans are in
+//absolute clocks, so only robots that fall behind or get ahead of their plan,
+//and the robots queued behind them, are planned again.
+class speed_schedule {
+	public:
+		void init(int num_robots, int num_nodes) {
+			_robots.assign(num_robots, Robot_Plan());
+			_order.assign(num_nodes, std::vector<int>());
+			_dirty.clear();
+			for (int i = 0; i < num_robots; i++) {
+				_robots[i].next_leg = 0;
+				_robots[i].position = 0;
+				_robots[i].speed = 0;
+				_robots[i].commanded = 0;
+				_robots[i].start = 0;
+				_robots[i].moving = false;
+				_robots[i].active = true;
+				_robots[i].target = SCHEDULE_SPEED_MAX;
+				_robots[i].dirty = false;
+				mark(i);
+			}
+		}
+
+		//intersections in the order a robot reaches them, path_index is where it is on the path
+		void add_leg(int robot, int node, int path_index) {
+			Leg leg;
+			leg.node = node;
+			leg.position = path_index*SCHEDULE_GRID - SCHEDULE_GRID/2 - SCHEDULE_CHECK;
+			leg.exit = path_index*SCHEDULE_GRID + SCHEDULE_GRID/2;
+			leg.arrive = leg.leave = 0;
+			leg.speed = SCHEDULE_SPEED_MAX;
+			_robots[robot].legs.push_back(leg);
+		}
+
+		void add_order(int node, int robot) {			//robots in the order they use an intersection
+			_order[node].push_back(robot);
+		}
+
+		//EVENTS
+		void released(int robot, int clock) {
+			_robots[robot].start = clock + SCHEDULE_STARTUP;
+			_robots[robot].moving = true;
+			mark(robot);
+		}
+
+		void stopped(int robot) {						//a stopped robot drops its unused tokens
+			_robots[robot].moving = false;
+			_robots[robot].speed = 0;
+			_robots[robot].commanded = 0;
+			mark(robot);
+		}
+
+		void resumed(int robot) {
+			if (!_robots[robot].moving) {
+				_robots[robot].moving = true;
+				mark(robot);
+			}
+		}
+
+		void crossed(int robot, int path_index) {		//robot entered the grid at path_index
+			Robot_Plan& plan = _robots[robot];
+			int position = path_index*SCHEDULE_GRID - SCHEDULE_GRID/2;
+			int error = plan.position - position;
+			plan.position = position;
+			if (error > SCHEDULE_TOLERANCE || error < -SCHEDULE_TOLERANCE) {
+				mark(robot);
+			}
+			while (plan.next_leg < (int)plan.legs.size() && plan.legs[plan.next_leg].exit <= position) {
+				leave_node(robot, plan.legs[plan.next_leg].node);	//out of the intersection grid
+				plan.next_leg++;
+				mark(robot);
+			}
+		}
+
+		void finished(int robot) {
+			Robot_Plan& plan = _robots[robot];
+			for (; plan.next_leg < (int)plan.legs.size(); plan.next_leg++) {
+				leave_node(robot, plan.legs[plan.next_leg].node);
+			}
+			plan.active = false;
+			plan.moving = false;
+		}
+
+		void tick(int clock) {							//follow every moving robot between events
+			for (int i = 0; i < (int)_robots.size(); i++) {
+				Robot_Plan& plan = _robots[i];
+				if (!plan.active || !plan.moving || clock < plan.start) {
+					continue;
+				}
+				if (clock % SCHEDULE_STEP == 0 && plan.speed != plan.commanded) {
+					plan.speed = ramp(plan.speed, plan.commanded);
+				}
+				plan.position += plan.speed;
+			}
+		}
+
+		//SOLVE
+		void solve(int clock) {
+			int budget = _robots.size()*(_order.size() + 1)*4;		//orders are acyclic, this is only a guard
+			while (!_dirty.empty() && budget-- > 0) {
+				int robot = _dirty.back();
+				_dirty.pop_back();
+				_robots[robot].dirty = false;
+				if (plan(robot, clock)) {
+					Robot_Plan& plan = _robots[robot];
+					for (int j = plan.next_leg; j < (int)plan.legs.size(); j++) {
+						const std::vector<int>& order = _order[plan.legs[j].node];
+						for (int o = order.size() - 1; o >= 0 && order[o] != robot; o--) {
+							mark(order[o]);					//robots waiting behind this one
+						}
+					}
+				}
+			}
+		}
+
+		int target(int robot) const { return _robots[robot].target; }
+		int commanded(int robot) const { return _robots[robot].commanded; }
+
+		//tokens that take the robot from its commanded speed to its target, returns the speed reached
+		int profile(int robot, int* tokens, int max_tokens, int& n) const {
+			int speed = _robots[robot].commanded;
+			int target = _robots[robot].target;
+			n = 0;
+			while (n < max_tokens && speed + SCHEDULE_SPEED_UP <= target) {
+				tokens[n++] = 2;						//+100 mm/s
+				speed += SCHEDULE_SPEED_UP;
+			}
+			while (n < max_tokens && speed - SCHEDULE_SPEED_DOWN >= target && speed - SCHEDULE_SPEED_DOWN >= 0) {	//never below standstill
+				tokens[n++] = 1;						//-50 mm/s
+				speed -= SCHEDULE_SPEED_DOWN;
+			}
+			return speed;
+		}
+
+		void command(int robot, int speed) {
+			_robots[robot].commanded = speed;
+		}
+
+	private:
+		//LOCAL VAR
+		typedef struct Leg {
+			int node;			//intersection
+			int position;		//distance along the path where the robot asks to enter it
+			int exit;			//distance along the path where it is out of the intersection grid
+			int arrive;			//planned clock at position
+			int leave;			//planned clock at exit
+			int speed;			//planned speed on the way to position
+		}Leg;
+
+		typedef struct Robot_Plan {
+			std::vector<Leg> legs;
+			int next_leg;		//first intersection the robot has not left yet
+			int position;		//distance along the path, from the centre of the first grid
+			int speed;			//modelled speed
+			int commanded;		//speed once every token sent has been used
+			int start;			//clock the robot can start moving
+			int target;			//planned speed right now
+			bool moving;
+			bool active;
+			bool dirty;
+		}Robot_Plan;
+
+		std::vector<Robot_Plan> _robots;
+		std::vector<std::vector<int> > _order;		//robots still to leave each intersection
+		std::vector<int> _dirty;					//robots to plan again
+
+		void mark(int robot) {
+			if (!_robots[robot].dirty && _robots[robot].active) {
+				_robots[robot].dirty = true;
+				_dirty.push_back(robot);
+			}
+		}
+
+		void leave_node(int robot, int node) {
+			std::vector<int>& order = _order[node];
+			for (int o = 0; o < (int)order.size(); o++) {
+				if (order[o] == robot) {
+					order.erase(order.begin() + o);
+					break;
+				}
+			}
+			for (int o = 0; o < (int)order.size(); o++) {
+				mark(order[o]);
+			}
+		}
+
+		static int ramp(int speed, int target) {	//one token towards target
+			if (target > speed) {
+				return (speed + SCHEDULE_SPEED_UP > target) ? speed : speed + SCHEDULE_SPEED_UP;
+			}
+			return (speed - SCHEDULE_SPEED_DOWN < target) ? speed : speed - SCHEDULE_SPEED_DOWN;
+		}
+
+		//clocks to cover distance starting at speed and ramping towards target
+		static int travel(int speed, int target, int distance) {
+			int clocks = 0;
+			while (distance > 0) {
+				if (speed > 0 && (speed == ramp(speed, target) || speed*SCHEDULE_STEP >= distance)) {
+					return clocks + (distance + speed - 1)/speed;
+				}
+				distance -= speed*SCHEDULE_STEP;
+				clocks += SCHEDULE_STEP;
+				int next = ramp(speed, target);
+				if (next == speed) {
+					return -1;							//target can not be reached from a standstill
+				}
+				speed = next;
+			}
+			return clocks;
+		}
+
+		//leave time of the robot ahead at an intersection, -1 if there is none
+		int ahead_leave(int robot, int node) const {
+			const std::vector<int>& order = _order[node];
+			for (int o = 1; o < (int)order.size(); o++) {
+				if (order[o] == robot) {
+					const Robot_Plan& ahead = _robots[order[o-1]];
+					for (int j = ahead.next_leg; j < (int)ahead.legs.size(); j++) {
+						if (ahead.legs[j].node == node) {
+							return ahead.legs[j].leave;
+						}
+					}
+				}
+			}
+			return -1;
+		}
+
+		//plan one robot from where it is now, returns whether any leave time changed
+		bool plan(int robot, int clock) {
+			Robot_Plan& plan = _robots[robot];
+			int time = (clock > plan.start) ? clock : plan.start;
+			int position = plan.position;
+			int speed = plan.moving ? plan.speed : 0;
+			bool changed = false;
+			plan.target = -1;
+			for (int j = plan.next_leg; j < (int)plan.legs.size(); j++) {
+				Leg& leg = plan.legs[j];
+				if (position < leg.position) {
+					int not_before = ahead_leave(robot, leg.node);
+					not_before = (not_before == -1) ? 0 : not_before + SCHEDULE_MARGIN;
+					int arrive = -1;
+					int chosen = -1;
+					//fastest reachable speed that does not arrive early, else the slowest one
+					for (int candidate = SCHEDULE_SPEED_MAX; candidate >= SCHEDULE_SPEED_MIN; candidate -= SCHEDULE_SPEED_DOWN) {
+						if (!reachable(plan.commanded, candidate, plan.target == -1)) {
+							continue;
+						}
+						int clocks = travel(speed, candidate, leg.position - position);
+						if (clocks == -1) {
+							continue;
+						}
+						arrive = time + clocks;
+						chosen = candidate;
+						if (arrive >= not_before) {
+							break;
+						}
+					}
+					leg.speed = chosen;
+					leg.arrive = arrive;
+					if (plan.target == -1) {
+						plan.target = chosen;
+					}
+					position = leg.position;
+					time = arrive;
+					speed = chosen;
+				}
+				int leave = time + travel(speed > 0 ? speed : SCHEDULE_SPEED_MIN, SCHEDULE_SPEED_MAX, leg.exit - position);
+				changed |= (leave != leg.leave);
+				leg.leave = leave;
+				position = leg.exit;
+				time = leave;
+				speed = SCHEDULE_SPEED_MAX;
+			}
+			if (plan.target == -1) {
+				plan.target = SCHEDULE_SPEED_MAX;			//no intersection ahead
+			}
+			return changed;
+		}
+
+		//the speed sent now has to be reachable in whole tokens, later legs are only estimates
+		static bool reachable(int commanded, int speed, bool exact) {
+			if (!exact || speed == commanded) {
+				return true;
+			}
+			if (speed > commanded) {
+				return (speed - commanded) % SCHEDULE_SPEED_UP == 0;
+			}
+			return (commanded - speed) % SCHEDULE_SPEED_DOWN == 0;
+		}
+};
+
+#endif
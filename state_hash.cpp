@@ -0,0 +1,159 @@
+#ifndef STATE_HASH_CPP
+#define STATE_HASH_CPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define STATE_HASH_VERSION 2
+#define STATE_HASH_NAME 32			//bytes per field or agent name in the file
+
+//State hash file:
+//	header		"WHSH", version, number of fields, number of agents, interval (all uint32)
+//	names		one STATE_HASH_NAME byte, zero padded name per field, then per agent
+//	records		uint32 tick, uint32 0, uint64 chain, uint64 per field, uint64 per agent
+//A field hash covers that field over every agent, an agent hash covers every
+//field of that agent, and chain covers every tick so far. Two runs match up to
+//a tick if their chains match there; where they do not, the differing field and
+//agent hashes say what changed. Values are summed in, so the order modules add
+//their state in does not matter, and values are keyed by the field and agent
+//names, so neither does the order they were registered in.
+static inline uint64_t state_hash_mix(uint64_t value) {		//splitmix64 finalizer
+	value += 0x9e3779b97f4a7c15ull;
+	value = (value ^ (value >> 30))*0xbf58476d1ce4e5b9ull;
+	value = (value ^ (value >> 27))*0x94d049bb133111ebull;
+	return value ^ (value >> 31);
+}
+
+static inline uint64_t state_hash_combine(uint64_t hash, uint64_t value) {
+	return (hash ^ state_hash_mix(value))*0x100000001b3ull;
+}
+
+static inline uint64_t state_hash_name(const std::string& name) {	//FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (int i = 0; i < (int)name.size(); i++) {
+		hash = (hash ^ (uint8_t)name[i])*0x100000001b3ull;
+	}
+	return hash;
+}
+
+//hash of one value, keyed by what it is (field), whose it is (agent) and which one (index)
+static inline uint64_t state_hash_value(uint64_t field, uint64_t agent, int index, int64_t value) {
+	return state_hash_mix(state_hash_combine(state_hash_combine(state_hash_mix(field), agent), index) ^ (uint64_t)value);
+}
+
+class state_hasher {
+	public:
+		state_hasher():_file(0), _interval(1), _tick(-1), _chain(0) {}
+
+		~state_hasher() {
+			close();
+		}
+
+		//fields and agents are registered by the modules before the file is opened
+		int add_field(const std::string& name) {
+			for (int i = 0; i < (int)_fields.size(); i++) {
+				if (_fields[i] == name) {
+					return i;
+				}
+			}
+			_fields.push_back(name);
+			_field_key.push_back(state_hash_name(name));
+			return _fields.size() - 1;
+		}
+
+		int add_agent(const std::string& name) {
+			for (int i = 0; i < (int)_agents.size(); i++) {
+				if (_agents[i] == name) {
+					return i;
+				}
+			}
+			_agents.push_back(name);
+			_agent_key.push_back(state_hash_name(name));
+			return _agents.size() - 1;
+		}
+
+		bool open(const char* file_name, int interval) {
+			_file = fopen(file_name, "wb");
+			if (_file == NULL) {
+				return false;
+			}
+			_interval = (interval > 0) ? interval : 1;
+			uint32_t header[5] = {0, STATE_HASH_VERSION, (uint32_t)_fields.size(), (uint32_t)_agents.size(), (uint32_t)_interval};
+			memcpy(&header[0], "WHSH", 4);
+			fwrite(header, sizeof(header), 1, _file);
+			write_names(_fields);
+			write_names(_agents);
+			_field_hash.assign(_fields.size(), 0);
+			_agent_hash.assign(_agents.size(), 0);
+			return true;
+		}
+
+		void close() {
+			if (_file) {
+				flush();
+				fclose(_file);
+			}
+			_file = 0;
+		}
+
+		bool enabled() const { return _file != 0; }
+
+		//one value of the model state at a tick, every module adds its state each tick
+		void add(int tick, int field, int agent, int64_t value, int index = 0) {
+			if (tick != _tick) {
+				flush();
+				_tick = tick;
+			}
+			uint64_t hash = state_hash_value(_field_key[field], _agent_key[agent], index, value);
+			_field_hash[field] += hash;
+			_agent_hash[agent] += hash;
+		}
+
+	private:
+		FILE* _file;
+		int _interval;
+		int _tick;									//tick being collected
+		uint64_t _chain;
+		std::vector<std::string> _fields;
+		std::vector<std::string> _agents;
+		std::vector<uint64_t> _field_key;
+		std::vector<uint64_t> _agent_key;
+		std::vector<uint64_t> _field_hash;
+		std::vector<uint64_t> _agent_hash;
+
+		void write_names(const std::vector<std::string>& names) {
+			for (int i = 0; i < (int)names.size(); i++) {
+				char name[STATE_HASH_NAME];
+				memset(name, 0, sizeof(name));
+				strncpy(name, names[i].c_str(), sizeof(name) - 1);
+				fwrite(name, sizeof(name), 1, _file);
+			}
+		}
+
+		void flush() {
+			if (_tick < 0 || _file == 0) {
+				return;
+			}
+			for (int i = 0; i < (int)_field_hash.size(); i++) {
+				_chain = state_hash_combine(_chain, _field_hash[i]);
+			}
+			if (_tick % _interval == 0) {
+				uint32_t tick[2] = {(uint32_t)_tick, 0};
+				fwrite(tick, sizeof(tick), 1, _file);
+				fwrite(&_chain, sizeof(_chain), 1, _file);
+				fwrite(&_field_hash[0], sizeof(uint64_t), _field_hash.size(), _file);
+				fwrite(&_agent_hash[0], sizeof(uint64_t), _agent_hash.size(), _file);
+			}
+			_field_hash.assign(_field_hash.size(), 0);
+			_agent_hash.assign(_agent_hash.size(), 0);
+			_tick = -1;
+		}
+
+		state_hasher(const state_hasher&);
+		state_hasher& operator=(const state_hasher&);
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef STATIC_MAP_CPP
+#define STATIC_MAP_CPP
+
+#include "path_codec.cpp"
+
+//Map of a scenario baked into the binary, for builds with -DSTATIC_SCENARIO.
+//Same interface as map_view, but every table is built by the compiler from the
+//constexpr scenario arrays, so lookups are constant loads from .rodata and fold
+//away where the grid is known. The intersections of the robot paths are worked
+//out at compile time too, the same way as junction_graph::conflict_junctions(),
+//with a per grid index so finding the intersection on a grid is a single load.
+//	make CFLAGS='-O2 -DSTATIC_SCENARIO'								(the hand-drawn scenario)
+//	make CFLAGS='-O2 -DSTATIC_SCENARIO -DSCENARIO="\"floor.h\""'		(one from tools/scenario_gen)
+//Such a build has no -map, builds without the flag load any map at run time.
+template<int size_x_, int size_y_, const int (&cells)[size_y_][size_x_], int robots, int path_length,
+		 const int (&paths)[robots][path_length]> class static_map {
+	public:
+		static constexpr int size_x() { return size_x_; }
+		static constexpr int size_y() { return size_y_; }
+		static constexpr int num_grids() { return grids; }
+
+		static constexpr bool walkable(int x, int y) { return cells[y][x] >= 0; }
+		static constexpr int grid(int x, int y) { return cells[y][x]; }		//grid number at map xy, -1 if blocked
+
+		static constexpr int grid_x(int grid) {			//map xy coordinate of a grid number, -1 if unknown
+			return (grid < 0 || grid > grids) ? -1 : _tables.grid_x[grid];
+		}
+
+		static constexpr int grid_y(int grid) {
+			return (grid < 0 || grid > grids) ? -1 : _tables.grid_y[grid];
+		}
+
+		static constexpr int neighbour(int grid, int direction) {
+			return _tables.adjacency[grid*4 + direction];
+		}
+
+		static constexpr const int* grid_x_table() { return _tables.grid_x; }
+		static constexpr const int* grid_y_table() { return _tables.grid_y; }
+
+		static constexpr int num_junctions() { return _tables.num_junctions; }
+		static constexpr const int* junctions() { return _tables.junctions; }	//intersections, ascending
+		static constexpr int junction_of(int grid) {	//index in junctions(), -1 if none on the grid
+			return (grid < 0 || grid > grids) ? -1 : _tables.junction_of[grid];
+		}
+
+	private:
+		static constexpr int max_grid() {
+			int highest = 0;
+			for (int y = 0; y < size_y_; y++) {
+				for (int x = 0; x < size_x_; x++) {
+					highest = (cells[y][x] > highest) ? cells[y][x] : highest;
+				}
+			}
+			return highest;
+		}
+
+		static constexpr int grids = max_grid();
+
+		typedef struct Tables {
+			int grid_x[grids + 1];
+			int grid_y[grids + 1];
+			int adjacency[(grids + 1)*4];		//PATH_RIGHT/LEFT/UP/DOWN neighbour or -1, like the map file
+			int junction_of[grids + 1];
+			int junctions[grids + 1];
+			int num_junctions;
+		}Tables;
+
+		static constexpr Tables build() {
+			Tables t = {};
+			for (int i = 0; i <= grids; i++) {
+				t.grid_x[i] = t.grid_y[i] = -1;
+				t.adjacency[i*4 + PATH_RIGHT] = t.adjacency[i*4 + PATH_LEFT] = -1;
+				t.adjacency[i*4 + PATH_UP] = t.adjacency[i*4 + PATH_DOWN] = -1;
+				t.junction_of[i] = -1;
+			}
+			for (int y = 0; y < size_y_; y++) {
+				for (int x = 0; x < size_x_; x++) {
+					int id = cells[y][x];
+					if (id < 0) {
+						continue;
+					}
+					t.grid_x[id] = x;
+					t.grid_y[id] = y;
+					if (x + 1 < size_x_) t.adjacency[id*4 + PATH_RIGHT] = cells[y][x + 1];
+					if (x > 0) t.adjacency[id*4 + PATH_LEFT] = cells[y][x - 1];
+					if (y + 1 < size_y_) t.adjacency[id*4 + PATH_UP] = cells[y + 1][x];
+					if (y > 0) t.adjacency[id*4 + PATH_DOWN] = cells[y - 1][x];
+				}
+			}
+
+			//a junction where robots come in from different grids is an intersection
+			int first_robot[grids + 1] = {};
+			int entered[grids + 1] = {};
+			bool conflict[grids + 1] = {};
+			for (int g = 0; g <= grids; g++) {
+				first_robot[g] = -1;
+			}
+			for (int robot = 0; robot < robots; robot++) {
+				for (int i = 1; i < path_length && paths[robot][i] != -1; i++) {
+					int g = paths[robot][i];
+					int degree = 0;
+					for (int dir = 0; g >= 1 && g <= grids && dir < 4; dir++) {
+						degree += t.adjacency[g*4 + dir] != -1;
+					}
+					if (degree <= 2) {
+						continue;
+					}
+					if (first_robot[g] == -1) {
+						first_robot[g] = robot;
+						entered[g] = paths[robot][i-1];
+					}
+					else if (first_robot[g] != robot && entered[g] != paths[robot][i-1]) {
+						conflict[g] = true;
+					}
+				}
+			}
+			t.num_junctions = 0;
+			for (int g = 0; g <= grids; g++) {
+				if (conflict[g]) {
+					t.junction_of[g] = t.num_junctions;
+					t.junctions[t.num_junctions++] = g;
+				}
+			}
+			return t;
+		}
+
+		static constexpr Tables _tables = build();
+};
+
+#endif
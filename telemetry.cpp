@@ -0,0 +1,249 @@
+#ifndef TELEMETRY_CPP
+#define TELEMETRY_CPP
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_SLOTS 64			//frames kept per channel
+#define TELEMETRY_PROCESSING 0		//channel with processing's robots and obstacles
+#define TELEMETRY_SERVER 1			//channel with the server's robot table
+#define TELEMETRY_CHANNELS 2
+
+//Shared memory layout, all little endian and 8 byte aligned:
+//	header			Telemetry_Header, with one Telemetry_Channel per channel
+//	channel slots	TELEMETRY_SLOTS slots per channel, each a Telemetry_Slot followed by its records
+//		processing:	num_robots Telemetry_Robot, then num_obstacles Telemetry_Obstacle
+//		server:		num_robots Telemetry_Server_Robot
+//Every slot is a seqlock: seq is odd while the simulator writes it. A reader
+//copies a slot and keeps the copy only if seq was even and did not change.
+typedef struct Telemetry_Channel {
+	uint64_t offset;			//first slot
+	uint32_t slot_size;			//bytes per slot, header included
+	uint32_t num_slots;
+	uint64_t head;				//frames written so far, the newest is slot (head-1) % num_slots
+}Telemetry_Channel;
+
+typedef struct Telemetry_Header {
+	char magic[4];				//"WTEL"
+	uint32_t version;
+	uint32_t num_robots;
+	uint32_t num_obstacles;
+	uint32_t num_channels;
+	uint32_t reserved;
+	uint64_t size;				//bytes in the whole region
+	Telemetry_Channel channel[TELEMETRY_CHANNELS];
+}Telemetry_Header;
+
+typedef struct Telemetry_Slot {
+	uint32_t seq;
+	uint32_t reserved;
+	uint64_t tick;				//clock count of the frame
+}Telemetry_Slot;
+
+typedef struct Telemetry_Robot {
+	int32_t status;
+	int32_t current_grid;
+	int32_t next_grid;
+	int32_t position_x;			//position in the current grid
+	int32_t position_y;
+	int32_t speed;
+}Telemetry_Robot;
+
+typedef struct Telemetry_Obstacle {
+	int32_t status;
+	int32_t current_grid;
+	int32_t next_grid;
+	int32_t position_x;
+	int32_t position_y;
+	int32_t reserved;
+}Telemetry_Obstacle;
+
+typedef struct Telemetry_Server_Robot {
+	int32_t status;
+	int32_t current_grid;
+	int32_t next_grid;
+	int32_t speed;
+}Telemetry_Server_Robot;
+
+static inline uint32_t telemetry_slot_size(int channel, int num_robots, int num_obstacles) {
+	uint32_t records = (channel == TELEMETRY_PROCESSING) ?
+		num_robots*sizeof(Telemetry_Robot) + num_obstacles*sizeof(Telemetry_Obstacle) :
+		num_robots*sizeof(Telemetry_Server_Robot);
+	return (sizeof(Telemetry_Slot) + records + 7) & ~(uint32_t)7;
+}
+
+//Writer side, owned by sc_main. Modules fill a frame in place between
+//begin() and commit(); nothing is copied or formatted on the simulator side.
+class telemetry_publisher {
+	public:
+		telemetry_publisher():_header(0), _size(0) {
+			_name[0] = 0;
+		}
+
+		~telemetry_publisher() {
+			close();
+		}
+
+		bool open(const char* name, int num_robots, int num_obstacles) {
+			close();
+			uint64_t size = (sizeof(Telemetry_Header) + 7) & ~(uint64_t)7;
+			uint64_t offset[TELEMETRY_CHANNELS];
+			for (int c = 0; c < TELEMETRY_CHANNELS; c++) {
+				offset[c] = size;
+				size += (uint64_t)telemetry_slot_size(c, num_robots, num_obstacles)*TELEMETRY_SLOTS;
+			}
+			int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+			if (fd == -1) {
+				return false;
+			}
+			if (ftruncate(fd, size) == -1) {
+				::close(fd);
+				shm_unlink(name);
+				return false;
+			}
+			void* base = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (base == MAP_FAILED) {
+				shm_unlink(name);
+				return false;
+			}
+			memset(base, 0, size);
+			_header = (Telemetry_Header*)base;
+			_size = size;
+			strncpy(_name, name, sizeof(_name) - 1);
+			_name[sizeof(_name) - 1] = 0;
+			_header->version = TELEMETRY_VERSION;
+			_header->num_robots = num_robots;
+			_header->num_obstacles = num_obstacles;
+			_header->num_channels = TELEMETRY_CHANNELS;
+			_header->size = size;
+			for (int c = 0; c < TELEMETRY_CHANNELS; c++) {
+				_header->channel[c].offset = offset[c];
+				_header->channel[c].slot_size = telemetry_slot_size(c, num_robots, num_obstacles);
+				_header->channel[c].num_slots = TELEMETRY_SLOTS;
+			}
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+			memcpy(_header->magic, "WTEL", 4);		//readers accept the region from here on
+			return true;
+		}
+
+		void close() {
+			if (_header) {
+				munmap(_header, _size);
+				shm_unlink(_name);					//readers keep their own mapping
+			}
+			_header = 0;
+		}
+
+		//records of the next frame of a channel, valid until commit()
+		void* begin(int channel, uint64_t tick) {
+			Telemetry_Slot* slot = next_slot(channel);
+			uint32_t seq = slot->seq;
+			__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+			slot->tick = tick;
+			return slot + 1;
+		}
+
+		void commit(int channel) {
+			Telemetry_Slot* slot = next_slot(channel);
+			__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+			__atomic_store_n(&_header->channel[channel].head, _header->channel[channel].head + 1, __ATOMIC_RELEASE);
+		}
+
+	private:
+		Telemetry_Header* _header;
+		uint64_t _size;
+		char _name[256];
+
+		Telemetry_Slot* next_slot(int channel) {
+			const Telemetry_Channel& c = _header->channel[channel];
+			return (Telemetry_Slot*)((char*)_header + c.offset + (c.head % c.num_slots)*c.slot_size);
+		}
+
+		telemetry_publisher(const telemetry_publisher&);
+		telemetry_publisher& operator=(const telemetry_publisher&);
+};
+
+//Reader side, for any local process. Maps the region read-only.
+class telemetry_view {
+	public:
+		telemetry_view():_header(0), _size(0) {}
+
+		~telemetry_view() {
+			close();
+		}
+
+		bool open(const char* name) {
+			close();
+			int fd = shm_open(name, O_RDONLY, 0);
+			if (fd == -1) {
+				return false;
+			}
+			struct stat info;
+			if (fstat(fd, &info) == -1 || (uint64_t)info.st_size < sizeof(Telemetry_Header)) {
+				::close(fd);
+				return false;
+			}
+			void* base = mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (base == MAP_FAILED) {
+				return false;
+			}
+			_header = (const Telemetry_Header*)base;
+			_size = info.st_size;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (memcmp(_header->magic, "WTEL", 4) != 0 || _header->version != TELEMETRY_VERSION ||
+				_header->size > _size || _header->num_channels != TELEMETRY_CHANNELS) {
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		void close() {
+			if (_header) {
+				munmap((void*)_header, _size);
+			}
+			_header = 0;
+		}
+
+		int num_robots() const { return _header->num_robots; }
+		int num_obstacles() const { return _header->num_obstacles; }
+
+		uint64_t head(int channel) const {
+			return __atomic_load_n(&_header->channel[channel].head, __ATOMIC_ACQUIRE);
+		}
+
+		//copy frame number index of a channel, false if it was overwritten or is being written
+		bool read(int channel, uint64_t index, uint64_t& tick, void* records, int size) const {
+			const Telemetry_Channel& c = _header->channel[channel];
+			if (index >= head(channel) || index + c.num_slots < head(channel) ||
+				size > (int)(c.slot_size - sizeof(Telemetry_Slot))) {
+				return false;
+			}
+			const Telemetry_Slot* slot = (const Telemetry_Slot*)((const char*)_header + c.offset + (index % c.num_slots)*c.slot_size);
+			uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+			if (seq & 1) {
+				return false;
+			}
+			tick = slot->tick;
+			memcpy(records, slot + 1, size);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq && index + c.num_slots >= head(channel);
+		}
+
+	private:
+		const Telemetry_Header* _header;
+		uint64_t _size;
+
+		telemetry_view(const telemetry_view&);
+		telemetry_view& operator=(const telemetry_view&);
+};
+
+#endif
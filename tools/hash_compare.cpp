@@ -0,0 +1,130 @@
+//Compares two state hash files written with -hash and reports the first tick
+//where the runs differ, with the fields and agents that changed there.
+//	make hash_compare
+//	./hash_compare reference.hash candidate.hash
+//If the files hash different state, e.g. one partition of a -partitions run
+//against a single process run, only the fields both of them hash are compared.
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "state_hash.cpp"
+
+typedef struct Hash_File {
+	FILE* file;
+	uint32_t header[5];						//magic, version, fields, agents, interval
+	std::vector<std::string> fields;
+	std::vector<std::string> agents;
+}Hash_File;
+
+static bool read_names(FILE* file, int count, std::vector<std::string>& names) {
+	for (int i = 0; i < count; i++) {
+		char name[STATE_HASH_NAME];
+		if (fread(name, sizeof(name), 1, file) != 1) {
+			return false;
+		}
+		name[STATE_HASH_NAME - 1] = 0;
+		names.push_back(name);
+	}
+	return true;
+}
+
+static bool open_hash(const char* file_name, Hash_File& hash) {
+	hash.file = fopen(file_name, "rb");
+	if (hash.file == NULL || fread(hash.header, sizeof(hash.header), 1, hash.file) != 1 ||
+		memcmp(&hash.header[0], "WHSH", 4) != 0 || hash.header[1] != STATE_HASH_VERSION) {
+		printf("Error: %s is not a state hash file\n", file_name);
+		return false;
+	}
+	return read_names(hash.file, hash.header[2], hash.fields) && read_names(hash.file, hash.header[3], hash.agents);
+}
+
+//one record: tick, chain, field hashes, agent hashes
+static bool read_record(Hash_File& hash, uint32_t& tick, std::vector<uint64_t>& values) {
+	uint32_t head[2];
+	values.resize(1 + hash.fields.size() + hash.agents.size());
+	return fread(head, sizeof(head), 1, hash.file) == 1 &&
+		   fread(&values[0], sizeof(uint64_t), values.size(), hash.file) == values.size() &&
+		   ((tick = head[0]), true);
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 3) {
+		printf("usage: %s <reference> <candidate>\n", argv[0]);
+		return 2;
+	}
+	Hash_File a, b;
+	if (!open_hash(argv[1], a) || !open_hash(argv[2], b)) {
+		return 2;
+	}
+	if (a.header[4] != b.header[4]) {
+		printf("Error: the files use a different interval\n");
+		return 2;
+	}
+	bool whole = (a.fields == b.fields && a.agents == b.agents);
+	std::vector<std::pair<int, int> > shared;		//(field in a, field in b)
+	for (int i = 0; i < (int)a.fields.size(); i++) {
+		for (int o = 0; o < (int)b.fields.size(); o++) {
+			if (a.fields[i] == b.fields[o]) {
+				shared.push_back(std::make_pair(i, o));
+			}
+		}
+	}
+	if (!whole) {
+		if (shared.empty()) {
+			printf("Error: the files hash different state\n");
+			return 2;
+		}
+		printf("comparing the %d fields both files hash\n", (int)shared.size());
+	}
+	std::vector<uint64_t> record_a, record_b;
+	uint32_t tick_a, tick_b;
+	int records = 0;
+	while (true) {
+		bool more_a = read_record(a, tick_a, record_a);
+		bool more_b = read_record(b, tick_b, record_b);
+		if (!more_a || !more_b) {
+			if (more_a != more_b) {
+				printf("runs match for %d records, then %s ends at tick %u\n", records,
+					   more_a ? argv[2] : argv[1], more_a ? tick_a : tick_b);
+				return 1;
+			}
+			printf("runs match: %d records\n", records);
+			return 0;
+		}
+		if (tick_a != tick_b) {
+			printf("records out of step: tick %u against tick %u\n", tick_a, tick_b);
+			return 1;
+		}
+		if (!whole) {
+			bool same = true;
+			for (int n = 0; n < (int)shared.size(); n++) {
+				same = same && record_a[1 + shared[n].first] == record_b[1 + shared[n].second];
+			}
+			if (!same) {
+				printf("first difference at tick %u\n", tick_a);
+				for (int n = 0; n < (int)shared.size(); n++) {
+					if (record_a[1 + shared[n].first] != record_b[1 + shared[n].second]) {
+						printf("  field %s\n", a.fields[shared[n].first].c_str());
+					}
+				}
+				return 1;
+			}
+		}
+		else if (record_a[0] != record_b[0]) {
+			printf("first difference at tick %u\n", tick_a);
+			for (int i = 0; i < (int)a.fields.size(); i++) {
+				if (record_a[1 + i] != record_b[1 + i]) {
+					printf("  field %s\n", a.fields[i].c_str());
+				}
+			}
+			for (int i = 0; i < (int)a.agents.size(); i++) {
+				if (record_a[1 + a.fields.size() + i] != record_b[1 + a.fields.size() + i]) {
+					printf("  agent %s\n", a.agents[i].c_str());
+				}
+			}
+			return 1;
+		}
+		records++;
+	}
+}
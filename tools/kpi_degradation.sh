@@ -0,0 +1,78 @@
+#!/bin/bash
+#Runs the warehouse under a set of link profiles and shows how the KPIs degrade.
+#	make degradation		(or: tools/kpi_degradation.sh [profiles...])
+#Every profile runs in degradation/<name>/ with -channels and -kpi, see
+#link_channel.cpp. degradation/summary.csv gets the fleet KPIs of each profile
+#and their change against the ideal links in percent. The channels are seeded,
+#so the same profiles give the same numbers on every run.
+#A run where not every robot reaches its goal has no makespan. Its status column
+#says "incomplete", "stalled" if no robot finished at all, or "failed" if the
+#run wrote no KPIs. A warning with the grids the fleet still covered goes to stderr.
+#The delay profiles sweep a fixed lossless latency: on the default scenario the
+#fleet still finishes at 40 ms one way and no longer does at 50 ms.
+#SYSTEMC_HOME must be set like for make all.
+
+#name ack_timeout_ms latency_ms jitter_ms distribution drop bandwidth_bit_s
+PROFILES="
+ideal		1	0	0	fixed		0		0
+lan			5	1	0.2	uniform		0		0
+wifi		30	8	4	exponential	0.02	250000
+congested	60	20	10	exponential	0.05	64000
+lossy		30	5	2	normal		0.15	0
+delay20		60	20	0	fixed		0		0
+delay40		120	40	0	fixed		0		0
+delay50		150	50	0	fixed		0		0
+"
+FIELDS="completed stops stopped_s queued_s mean_speed makespan_s"
+
+cd "$(dirname "$0")/.." || exit 1
+make -s all || exit 1
+mkdir -p degradation
+header="profile"
+for field in $FIELDS; do
+	header="$header,$field,${field}_change_pct"
+done
+header="$header,status"
+echo "$header" > degradation/summary.csv
+declare -A ideal
+echo "$PROFILES" | while read name ack latency jitter distribution drop bandwidth; do
+	if [ -z "$name" ] || { [ $# -gt 0 ] && [ "$name" != ideal ] && [[ " $* " != *" $name "* ]]; }; then
+		continue
+	fi
+	dir="degradation/$name"
+	mkdir -p "$dir"
+	{
+		echo "seed 1"
+		echo "ack_timeout $ack"
+		[ "$name" = ideal ] || echo "all $latency $jitter $distribution $drop $bandwidth"
+	} > "$dir/channels.cfg"
+	(cd "$dir" && ../../output -channels channels.cfg -kpi kpi -links links.json > stdout.txt) || echo "$name: run failed, see $dir/stdout.txt"
+	line="$name"
+	for field in $FIELDS; do
+		value=$(grep '"fleet"' "$dir/kpi.json" | sed -n "s/.*\"$field\": \([0-9.]*\).*/\1/p")	#null if never reached
+		if [ "$name" = ideal ]; then
+			ideal[$field]=$value
+		fi
+		change=$(awk -v a="${ideal[$field]}" -v b="$value" 'BEGIN { if (a != "" && b != "" && a != 0) printf "%.1f", (b - a)*100/a }')
+		line="$line,$value,$change"
+	done
+	robots=$(grep -c '"robot":' "$dir/kpi.json" 2>/dev/null)
+	completed=$(grep '"fleet"' "$dir/kpi.json" 2>/dev/null | sed -n 's/.*"completed": \([0-9]*\).*/\1/p')
+	grids=$(grep '"fleet"' "$dir/kpi.json" 2>/dev/null | sed -n 's/.*"grids": \([0-9]*\).*/\1/p')
+	if [ "${robots:-0}" -eq 0 ]; then
+		status=failed					#no KPIs written
+	elif [ "${completed:-0}" -ge "$robots" ]; then
+		status=complete
+	elif [ "${completed:-0}" -gt 0 ]; then
+		status=incomplete
+	else
+		status=stalled
+	fi
+	echo "$line,$status" >> degradation/summary.csv
+	echo "$name: ${completed:-0} of ${robots:-0} robots finished"
+	if [ "$status" = failed ]; then
+		echo "$name: WARNING run failed, no KPIs in $dir/kpi.json" >&2
+	elif [ "$status" != complete ]; then
+		echo "$name: WARNING run $status, ${completed:-0} of $robots robots finished in the simulated time and the fleet covered ${grids:-0} grids; no makespan, see $dir/stdout.txt" >&2
+	fi
+done
@@ -0,0 +1,58 @@
+//Writes a seeded warehouse scenario for main.cpp, see scenario.cpp.
+//	make scenario_gen
+//	./scenario_gen -seed 7 -size 40 25 -robots 16 -obstacles 8 -o big.h
+//	make CFLAGS='-O2 -DSCENARIO="\"big.h\""'
+//The map is also written as <header>.map for -map. tools/stress_suite.sh runs a
+//set of these from small to very large.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "scenario.cpp"
+
+int main(int argc, char* argv[]) {
+	Scenario_Params params = {1, 10, 9, 4, 6, SCENARIO_CROSS_AISLE, SCENARIO_OPENING};
+	const char* header = "scenario.h";
+	for (int i = 1; i < argc - 1; i++) {
+		if (strcmp(argv[i], "-seed") == 0) {
+			params.seed = strtoull(argv[++i], 0, 10);
+		}
+		else if (strcmp(argv[i], "-size") == 0 && i + 2 < argc) {
+			params.size_x = atoi(argv[++i]);
+			params.size_y = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-robots") == 0) {
+			params.robots = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-obstacles") == 0) {
+			params.obstacles = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-cross") == 0) {
+			params.cross_aisle = atoi(argv[++i]);			//columns between two cross-aisles
+		}
+		else if (strcmp(argv[i], "-opening") == 0) {
+			params.opening = atoi(argv[++i]);				//percent of rack cells that are gaps
+		}
+		else if (strcmp(argv[i], "-o") == 0) {
+			header = argv[++i];
+		}
+	}
+	if (params.size_x < 3 || params.size_y < 3 || params.robots < 1 || params.obstacles < 0 || params.cross_aisle < 2) {
+		printf("usage: %s [-seed n] [-size x y] [-robots n] [-obstacles n] [-cross n] [-opening percent] [-o header]\n", argv[0]);
+		return 1;
+	}
+	std::string map_file = std::string(header) + ".map";
+	scenario generated;
+	if (!generated.generate(params)) {
+		printf("Error: no %dx%d layout with room for %d robots and %d obstacles\n",
+			   params.size_x, params.size_y, params.robots, params.obstacles);
+		return 1;
+	}
+	if (!generated.write_header(header) || !map_file_write(map_file.c_str(), generated.map(), params.size_x, params.size_y)) {
+		printf("Error: could not write %s\n", header);
+		return 1;
+	}
+	printf("%s: %dx%d, %d robots, %d obstacles, path length %d, %d ms\n", header, params.size_x, params.size_y,
+		   params.robots, params.obstacles, generated.path_length(), generated.sim_time());
+	return 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/bash
+#Generated scenarios from small to very large, each built and run with -kpi.
+#	make stress		(or: tools/stress_suite.sh [names...])
+#Every scenario runs in stress/<name>/ and stress/summary.csv gets one line per
+#scenario with its size, the wall time of the run and the robots that finished.
+#The same seeds give the same scenarios, so runs of two builds can be compared.
+#SYSTEMC_HOME must be set like for make all, extra compiler flags go in CFLAGS.
+
+#name seed size_x size_y robots obstacles
+SUITE="
+small		1	10	9	4	6
+medium		2	30	21	16	12
+large		3	60	41	64	32
+huge		4	120	81	256	96
+"
+
+cd "$(dirname "$0")/.." || exit 1
+make -s scenario_gen || exit 1
+mkdir -p stress
+echo "scenario,size_x,size_y,robots,obstacles,sim_ms,wall_s,completed" > stress/summary.csv
+echo "$SUITE" | while read name seed size_x size_y robots obstacles; do
+	if [ -z "$name" ] || { [ $# -gt 0 ] && [[ " $* " != *" $name "* ]]; }; then
+		continue
+	fi
+	dir="stress/$name"
+	mkdir -p "$dir"
+	./scenario_gen -seed "$seed" -size "$size_x" "$size_y" -robots "$robots" -obstacles "$obstacles" -o "$dir/scenario.h" || exit 1
+	g++ -I. -I"$SYSTEMC_HOME/include" -L. -L"$SYSTEMC_HOME/lib-linux64" -Wl,-rpath="$SYSTEMC_HOME/lib-linux64" \
+		-O2 -DSCENARIO="\"$dir/scenario.h\"" -o "$dir/output" *.cpp -lsystemc -lm -lrt -pthread $CFLAGS || exit 1
+	start=$(date +%s%N)
+	(cd "$dir" && ./output -map scenario.h.map -kpi kpi > stdout.txt) || echo "$name: run failed, see $dir/stdout.txt"
+	end=$(date +%s%N)
+	sim_ms=$(sed -n 's/^#define SIM_TIME //p' "$dir/scenario.h")
+	completed=$(sed -n 's/.*"completed": \([0-9]*\).*/\1/p' "$dir/kpi.json")
+	wall=$(( (end - start)/1000000 ))
+	printf "%s,%s,%s,%s,%s,%s,%d.%03d,%s\n" "$name" "$size_x" "$size_y" "$robots" "$obstacles" "$sim_ms" \
+		$((wall/1000)) $((wall%1000)) "${completed:-0}" >> stress/summary.csv
+	echo "$name: ${robots} robots on ${size_x}x${size_y} in $((wall/1000)).$((wall%1000/100)) s, ${completed:-0} finished"
+done
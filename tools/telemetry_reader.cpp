@@ -0,0 +1,64 @@
+//Reference reader for the simulator's shared memory telemetry.
+//	make telemetry_reader
+//	./output -telemetry /warehouse &
+//	./telemetry_reader /warehouse
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include "telemetry.cpp"
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		printf("usage: %s <shm name>\n", argv[0]);
+		return 1;
+	}
+	telemetry_view view;
+	while (!view.open(argv[1])) {					//wait for the simulator to start
+		usleep(100000);
+	}
+	int robots = view.num_robots();
+	int obstacles = view.num_obstacles();
+	std::vector<char> frame(robots*sizeof(Telemetry_Robot) + obstacles*sizeof(Telemetry_Obstacle));
+	std::vector<Telemetry_Server_Robot> server(robots);
+	uint64_t next = 0;
+	int idle = 0;
+	while (idle < 2000) {							//stop once the simulator has gone quiet for 2 s
+		uint64_t head = view.head(TELEMETRY_PROCESSING);
+		if (next == head) {
+			usleep(1000);
+			idle++;
+			continue;
+		}
+		idle = 0;
+		if (next + TELEMETRY_SLOTS <= head) {
+			printf("skipped %llu frames\n", (unsigned long long)(head - next - 1));
+			next = head - 1;						//fell behind, jump to the newest frame
+		}
+		uint64_t tick;
+		uint64_t server_tick = 0;
+		if (!view.read(TELEMETRY_PROCESSING, next, tick, &frame[0], frame.size())) {
+			continue;								//overwritten while copying, try again
+		}
+		uint64_t server_head = view.head(TELEMETRY_SERVER);
+		bool have_server = server_head > 0 &&
+			view.read(TELEMETRY_SERVER, server_head - 1, server_tick, &server[0], robots*sizeof(Telemetry_Server_Robot));
+		const Telemetry_Robot* robot = (const Telemetry_Robot*)&frame[0];
+		const Telemetry_Obstacle* obstacle = (const Telemetry_Obstacle*)(robot + robots);
+		printf("tick %llu\n", (unsigned long long)tick);
+		for (int i = 0; i < robots; i++) {
+			printf("  robot %d grid %d -> %d (%d, %d) speed %d status %d", i + 1, robot[i].current_grid, robot[i].next_grid,
+				   robot[i].position_x, robot[i].position_y, robot[i].speed, robot[i].status);
+			if (have_server) {
+				printf(" | server status %d speed %d", server[i].status, server[i].speed);
+			}
+			printf("\n");
+		}
+		for (int i = 0; i < obstacles; i++) {
+			printf("  obstacle %d grid %d -> %d (%d, %d)\n", i + 1, obstacle[i].current_grid, obstacle[i].next_grid,
+				   obstacle[i].position_x, obstacle[i].position_y);
+		}
+		next++;
+	}
+	return 0;
+}
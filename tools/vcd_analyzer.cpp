@@ -0,0 +1,402 @@
+//Summaries of a VCD written by the model, in one streaming pass.
+//	make vcd_analyzer
+//	./vcd_analyzer robot_trace.vcd [-o prefix] [-series signal]...
+//The file is mmap'ed and read front to back; pages already parsed are dropped,
+//so memory stays bounded by the number of signals and the values they take,
+//not by the length of the trace. Writes, as CSV:
+//	<prefix>_signals.csv	every signal: changes and their rate, rising edges, time high, value range
+//	<prefix>_speed.csv		*_speed signals: seconds spent in each SPEED_BIN wide speed band
+//	<prefix>_dwell.csv		*_current_grid signals: visits, total and longest stay on each grid
+//	<prefix>_series.csv		time and value of every change of the -series signals
+//The prefix defaults to the trace name without .vcd. A handshake that completes
+//within one time step leaves no trace on its flag and ack, but every frame has a
+//new sequence number, so the changes of a tx_data/rx_data signal count its
+//handshakes. Flags that stay up across time steps are retries waiting for an ack.
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define SPEED_BIN 100				//mm/s per band of the speed histogram
+#define DROP_CHUNK (64 << 20)		//parsed bytes given back to the kernel at a time
+
+typedef struct Dwell {
+	int visits;
+	double total;					//seconds
+	double longest;
+}Dwell;
+
+typedef struct Signal {
+	std::string name;
+	int width;
+	bool speed;						//robot_N_speed: time at speed
+	bool grid;						//robot_N_current_grid: dwell times
+	bool series;					//every change goes to the series file
+	bool known;						//has had a value
+	int64_t value;
+	double since;					//seconds, time of the last change
+	int64_t changes;
+	int64_t rising;					//0 -> 1 edges of 1 bit signals
+	double high;					//seconds at 1
+	int64_t min;
+	int64_t max;
+	std::map<int64_t, double> bands;	//speed band -> seconds
+	std::map<int64_t, Dwell> dwell;		//grid -> stays
+}Signal;
+
+static bool ends_with(const std::string& s, const char* suffix) {
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool is(const char* text, size_t length, const char* word) {
+	return length == strlen(word) && strncmp(text, word, length) == 0;
+}
+
+//VCD identifiers are up to a few printable characters, packed into one key
+static uint64_t id_key(const char* id, size_t length) {
+	uint64_t key = 0;
+	for (size_t i = 0; i < length && i < 8; i++) {
+		key = (key << 8) | (uint8_t)id[i];
+	}
+	return key ^ ((uint64_t)length << 56);
+}
+
+class vcd_stream {
+	public:
+		vcd_stream():_base(0), _length(0), _at(0), _dropped(0) {}
+
+		~vcd_stream() {
+			if (_base) {
+				munmap((void*)_base, _length);
+			}
+		}
+
+		bool open(const char* file_name) {
+			int fd = ::open(file_name, O_RDONLY);
+			if (fd == -1) {
+				return false;
+			}
+			struct stat info;
+			if (fstat(fd, &info) == -1 || info.st_size == 0) {
+				::close(fd);
+				return false;
+			}
+			void* base = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (base == MAP_FAILED) {
+				return false;
+			}
+			_base = (const char*)base;
+			_length = info.st_size;
+			madvise(base, _length, MADV_SEQUENTIAL);
+			return true;
+		}
+
+		//next whitespace separated token, false at the end of the file
+		bool token(const char*& text, size_t& length) {
+			while (_at < _length && (unsigned char)_base[_at] <= ' ') {
+				_at++;
+			}
+			if (_at == _length) {
+				return false;
+			}
+			text = _base + _at;
+			while (_at < _length && (unsigned char)_base[_at] > ' ') {
+				_at++;
+			}
+			length = _base + _at - text;
+			if (_at - _dropped >= DROP_CHUNK) {		//the parsed part is not read again
+				size_t page = sysconf(_SC_PAGESIZE);
+				size_t end = (text - _base)/page*page;
+				if (end > _dropped) {
+					madvise((void*)(_base + _dropped), end - _dropped, MADV_DONTNEED);
+					_dropped = end;
+				}
+			}
+			return true;
+		}
+
+	private:
+		const char* _base;
+		size_t _length;
+		size_t _at;
+		size_t _dropped;
+};
+
+class vcd_analyzer {
+	public:
+		vcd_analyzer():_scale(1e-12), _now(0), _series(0) {}
+
+		bool run(const char* file_name, const std::vector<std::string>& series, FILE* series_file) {
+			if (!_vcd.open(file_name)) {
+				printf("Error: could not map %s\n", file_name);
+				return false;
+			}
+			_series = series_file;
+			if (!read_header(series)) {
+				printf("Error: %s has no $enddefinitions\n", file_name);
+				return false;
+			}
+			read_changes();
+			for (size_t i = 0; i < _signals.size(); i++) {
+				close_interval(_signals[i]);
+			}
+			return true;
+		}
+
+		bool write(const std::string& prefix) const {
+			FILE* signals = fopen((prefix + "_signals.csv").c_str(), "w");
+			FILE* speed = fopen((prefix + "_speed.csv").c_str(), "w");
+			FILE* dwell = fopen((prefix + "_dwell.csv").c_str(), "w");
+			bool opened = signals && speed && dwell;
+			if (opened) {
+				fprintf(signals, "signal,width,changes,changes_per_s,rising,high_s,min,max\n");
+				fprintf(speed, "signal,band_mm_s,seconds\n");
+				fprintf(dwell, "signal,grid,visits,total_s,mean_s,longest_s\n");
+				for (size_t i = 0; i < _signals.size(); i++) {
+					const Signal& s = _signals[i];
+					fprintf(signals, "%s,%d,%lld,%.3f,%lld,%.2f,%lld,%lld\n", s.name.c_str(), s.width, (long long)s.changes,
+							_now > 0 ? s.changes/_now : 0.0, (long long)s.rising, s.high, (long long)s.min, (long long)s.max);
+					for (std::map<int64_t, double>::const_iterator b = s.bands.begin(); b != s.bands.end(); ++b) {
+						fprintf(speed, "%s,%lld,%.2f\n", s.name.c_str(), (long long)b->first*SPEED_BIN, b->second);
+					}
+					for (std::map<int64_t, Dwell>::const_iterator d = s.dwell.begin(); d != s.dwell.end(); ++d) {
+						fprintf(dwell, "%s,%lld,%d,%.2f,%.2f,%.2f\n", s.name.c_str(), (long long)d->first, d->second.visits,
+								d->second.total, d->second.total/d->second.visits, d->second.longest);
+					}
+				}
+			}
+			bool closed = true;
+			FILE* files[3] = {signals, speed, dwell};
+			for (int f = 0; f < 3; f++) {
+				closed = (files[f] == NULL || fclose(files[f]) == 0) && closed;
+			}
+			return opened && closed;
+		}
+
+		int num_signals() const { return _signals.size(); }
+		double duration() const { return _now; }
+
+	private:
+		vcd_stream _vcd;
+		double _scale;						//seconds per time unit
+		double _now;						//seconds
+		FILE* _series;
+		std::vector<Signal> _signals;
+		std::unordered_map<uint64_t, int> _ids;		//identifier -> signal
+
+		bool read_header(const std::vector<std::string>& series) {
+			const char* text;
+			size_t length;
+			while (_vcd.token(text, length)) {
+				std::string word(text, length);
+				if (word == "$enddefinitions") {
+					skip_to_end();
+					return true;
+				}
+				else if (word == "$timescale") {
+					read_timescale();
+				}
+				else if (word == "$var") {
+					std::vector<std::string> fields;			//type width id name [range]
+					while (_vcd.token(text, length) && !is(text, length, "$end")) {
+						fields.push_back(std::string(text, length));
+					}
+					if (fields.size() >= 4) {
+						add_signal(fields[3], atoi(fields[1].c_str()), fields[2], series);
+					}
+				}
+			}
+			return false;
+		}
+
+		void read_timescale() {
+			const char* text;
+			size_t length;
+			std::string scale;
+			while (_vcd.token(text, length) && !is(text, length, "$end")) {
+				scale += std::string(text, length);
+			}
+			size_t digits = scale.find_first_not_of("0123456789");
+			double amount = (digits == 0) ? 1 : atof(scale.substr(0, digits).c_str());
+			std::string unit = (digits == std::string::npos) ? "s" : scale.substr(digits);
+			const char* units[6] = {"fs", "ps", "ns", "us", "ms", "s"};
+			double seconds[6] = {1e-15, 1e-12, 1e-9, 1e-6, 1e-3, 1};
+			for (int u = 0; u < 6; u++) {
+				if (unit == units[u]) {
+					_scale = amount*seconds[u];
+				}
+			}
+		}
+
+		void add_signal(const std::string& name, int width, const std::string& id, const std::vector<std::string>& series) {
+			uint64_t key = id_key(id.data(), id.size());
+			if (_ids.count(key)) {
+				return;								//another name for a traced signal
+			}
+			Signal s;
+			s.name = name;
+			s.width = width;
+			s.speed = ends_with(name, "_speed");
+			s.grid = ends_with(name, "_current_grid");
+			s.series = false;
+			for (size_t i = 0; i < series.size(); i++) {
+				s.series = s.series || series[i] == name;
+			}
+			s.known = false;
+			s.value = 0;
+			s.since = 0;
+			s.changes = 0;
+			s.rising = 0;
+			s.high = 0;
+			s.min = INT64_MAX;
+			s.max = INT64_MIN;
+			_ids[key] = _signals.size();
+			_signals.push_back(s);
+		}
+
+		void skip_to_end() {
+			const char* text;
+			size_t length;
+			while (_vcd.token(text, length) && !is(text, length, "$end")) {
+			}
+		}
+
+		void read_changes() {
+			const char* text;
+			size_t length;
+			while (_vcd.token(text, length)) {
+				char kind = text[0];
+				if (kind == '#') {
+					_now = strtoull(std::string(text + 1, length - 1).c_str(), 0, 10)*_scale;
+				}
+				else if (kind == 'b' || kind == 'B' || kind == 'r' || kind == 'R') {
+					const char* value = text + 1;
+					size_t value_length = length - 1;
+					if (!_vcd.token(text, length)) {
+						break;
+					}
+					change(text, length, value, value_length, kind == 'r' || kind == 'R');
+				}
+				else if (kind == '0' || kind == '1' || kind == 'x' || kind == 'X' || kind == 'z' || kind == 'Z') {
+					change(text + 1, length - 1, text, 1, false);
+				}
+				else if (kind == '$' && is(text, length, "$comment")) {
+					skip_to_end();
+				}
+			}
+		}
+
+		//binary value, sign extended when all width bits are given (x and z read as 0)
+		static int64_t bits(const char* text, size_t length, int width) {
+			uint64_t value = 0;
+			for (size_t i = 0; i < length; i++) {
+				value = (value << 1) | (text[i] == '1');
+			}
+			if ((int)length == width && width > 1 && width < 64 && text[0] == '1') {
+				value |= ~(uint64_t)0 << width;
+			}
+			return (int64_t)value;
+		}
+
+		void change(const char* id, size_t length, const char* text, size_t text_length, bool real) {
+			std::unordered_map<uint64_t, int>::const_iterator found = _ids.find(id_key(id, length));
+			if (found == _ids.end()) {
+				return;
+			}
+			Signal& s = _signals[found->second];
+			int64_t value = real ? (int64_t)atof(std::string(text, text_length).c_str()) : bits(text, text_length, s.width);
+			if (s.known && value == s.value) {
+				return;
+			}
+			close_interval(s);
+			if (s.known) {
+				s.changes++;
+				if (s.width == 1 && value == 1) {
+					s.rising++;
+				}
+			}
+			s.known = true;
+			s.value = value;
+			s.since = _now;
+			if (s.grid) {
+				s.dwell[value].visits++;
+			}
+			s.min = (value < s.min) ? value : s.min;
+			s.max = (value > s.max) ? value : s.max;
+			if (s.series && _series) {
+				fprintf(_series, "%s,%.6f,%lld\n", s.name.c_str(), _now, (long long)value);
+			}
+		}
+
+		void close_interval(Signal& s) {			//the old value held from s.since until now
+			if (!s.known) {
+				return;
+			}
+			double held = _now - s.since;
+			if (s.width == 1 && s.value == 1) {
+				s.high += held;
+			}
+			if (s.speed) {
+				int64_t band = (s.value >= 0) ? s.value/SPEED_BIN : -((-s.value + SPEED_BIN - 1)/SPEED_BIN);
+				s.bands[band] += held;
+			}
+			if (s.grid) {
+				Dwell& d = s.dwell[s.value];
+				d.total += held;
+				d.longest = (held > d.longest) ? held : d.longest;
+			}
+			s.since = _now;
+		}
+};
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		printf("usage: %s <trace.vcd> [-o prefix] [-series signal]...\n", argv[0]);
+		return 2;
+	}
+	std::string prefix = argv[1];
+	if (ends_with(prefix, ".vcd")) {
+		prefix.resize(prefix.size() - 4);
+	}
+	std::vector<std::string> series;
+	for (int i = 2; i < argc - 1; i++) {
+		if (strcmp(argv[i], "-o") == 0) {
+			prefix = argv[++i];
+		}
+		else if (strcmp(argv[i], "-series") == 0) {
+			series.push_back(argv[++i]);
+		}
+	}
+	FILE* series_file = 0;
+	if (!series.empty()) {
+		series_file = fopen((prefix + "_series.csv").c_str(), "w");
+		if (series_file == NULL) {
+			printf("Error: could not write %s_series.csv\n", prefix.c_str());
+			return 2;
+		}
+		fprintf(series_file, "signal,time_s,value\n");
+	}
+	vcd_analyzer analyzer;
+	bool done = analyzer.run(argv[1], series, series_file);
+	if (series_file) {
+		fclose(series_file);
+	}
+	if (!done) {
+		return 1;
+	}
+	if (!analyzer.write(prefix)) {
+		printf("Error: could not write %s_*.csv\n", prefix.c_str());
+		return 1;
+	}
+	printf("%d signals over %.2f s\n", analyzer.num_signals(), analyzer.duration());
+	return 0;
+}
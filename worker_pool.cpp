@@ -0,0 +1,102 @@
+#ifndef WORKER_POOL_CPP
+#define WORKER_POOL_CPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define WORKER_POOL_SPIN 20000		//polls before a waiting worker goes to sleep
+
+//Fixed set of threads for data parallel steps inside one process activation.
+//run() hands out tasks 0..tasks-1 to the pool and the calling thread and
+//returns once all of them are done. Tasks must not touch the SystemC kernel.
+class worker_pool {
+	public:
+		//CONSTRUCTOR
+		worker_pool(int threads):_generation(0), _stop(false) {
+			for (int i = 1; i < threads; i++) {				//the caller is worker 0
+				_threads.push_back(std::thread(&worker_pool::worker, this));
+			}
+		}
+
+		~worker_pool() {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stop = true;
+				_generation++;
+			}
+			_wake.notify_all();
+			for (int i = 0; i < (int)_threads.size(); i++) {
+				_threads[i].join();
+			}
+		}
+
+		int size() const { return _threads.size() + 1; }
+
+		void run(int tasks, void (*task)(void*, int), void* context) {
+			if (tasks <= 1 || _threads.empty()) {
+				for (int i = 0; i < tasks; i++) {
+					task(context, i);
+				}
+				return;
+			}
+			_task = task;
+			_context = context;
+			_tasks = tasks;
+			_next.store(0, std::memory_order_relaxed);
+			_finished.store(0, std::memory_order_relaxed);
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_generation++;									//publishes the job
+			}
+			_wake.notify_all();
+			work();
+			while (_finished.load(std::memory_order_acquire) < (int)_threads.size()) {
+				std::this_thread::yield();				//every worker checks in, so none is left over for the next run
+			}
+		}
+
+	private:
+		std::vector<std::thread> _threads;
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::atomic<unsigned long> _generation;
+		bool _stop;
+		void (*_task)(void*, int);
+		void* _context;
+		int _tasks;
+		std::atomic<int> _next;								//next task to hand out
+		std::atomic<int> _finished;							//workers done with the current run
+
+		void work() {
+			for (int i = _next.fetch_add(1); i < _tasks; i = _next.fetch_add(1)) {
+				_task(_context, i);
+			}
+		}
+
+		void worker() {
+			unsigned long seen = 0;
+			while (true) {
+				int spins = 0;
+				while (_generation.load(std::memory_order_acquire) == seen && ++spins < WORKER_POOL_SPIN) {
+				}
+				if (_generation.load(std::memory_order_acquire) == seen) {
+					std::unique_lock<std::mutex> lock(_mutex);
+					_wake.wait(lock, [&]{ return _generation.load() != seen; });
+				}
+				seen = _generation.load(std::memory_order_acquire);
+				if (_stop) {
+					return;
+				}
+				work();
+				_finished.fetch_add(1, std::memory_order_release);
+			}
+		}
+
+		worker_pool(const worker_pool&);
+		worker_pool& operator=(const worker_pool&);
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef ZONE_MAP_CPP
+#define ZONE_MAP_CPP
+
+#include <vector>
+#include "map_file.cpp"
+
+//Map split into zones for the regional controllers. Zones are strips of whole
+//map columns, cut so each holds about the same number of grids. Every grid
+//belongs to exactly one zone.
+class zone_map {
+	public:
+		//CONSTRUCTOR
+		zone_map(const map_view* map, int zones) {
+			int num_grids = map->num_grids();
+			std::vector<int> column(map->size_x(), 0);			//grids in each map column
+			int total = 0;
+			for (int grid = 1; grid <= num_grids; grid++) {
+				if (map->grid_x(grid) != -1) {
+					column[map->grid_x(grid)]++;
+					total++;
+				}
+			}
+			if (zones < 1) {
+				zones = 1;
+			}
+			_column_zone.assign(map->size_x(), 0);
+			int zone = 0;
+			int filled = 0;
+			for (int x = 0; x < map->size_x(); x++) {
+				if (zone + 1 < zones && column[x] > 0 && filled >= (long long)total*(zone + 1)/zones) {
+					zone++;
+				}
+				_column_zone[x] = zone;
+				filled += column[x];
+			}
+			_num_zones = zone + 1;								//fewer if the map has fewer columns
+			_grid_zone.assign(num_grids + 1, -1);
+			for (int grid = 1; grid <= num_grids; grid++) {
+				if (map->grid_x(grid) != -1) {
+					_grid_zone[grid] = _column_zone[map->grid_x(grid)];
+				}
+			}
+		}
+
+		int num_zones() const { return _num_zones; }
+		int zone(int grid) const {								//-1 for grids not on the map
+			return (grid < 1 || grid >= (int)_grid_zone.size()) ? -1 : _grid_zone[grid];
+		}
+
+	private:
+		int _num_zones;
+		std::vector<int> _column_zone;
+		std::vector<int> _grid_zone;
+};
+
+#endif